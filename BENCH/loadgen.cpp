@@ -0,0 +1,702 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <stdexcept>
+#include <memory>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+// HTTP/1.1 load generator for the Xweb servers.
+//
+// Closed-loop mode keeps every connection busy with `pipeline` requests in
+// flight. Open-loop mode (--rate) sends on a fixed schedule and measures each
+// latency from the time the request was *supposed* to be sent, so stalls in
+// the server show up in the percentiles instead of silently lowering the
+// offered load (coordinated omission).
+
+constexpr int MAX_EVENTS = 256;
+// Delay before reopening a connection whose connect failed, doubling with
+// each failure in a row
+constexpr uint64_t MIN_BACKOFF_NS = 1000000;
+constexpr uint64_t MAX_BACKOFF_NS = 100000000;
+
+uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Log-linear histogram in the style of HdrHistogram: values below 2048 are
+// exact, larger values keep 3 significant digits (1024 sub-buckets per power
+// of two). Values are microseconds.
+class Histogram {
+private:
+    static constexpr int SUB_BUCKET_BITS = 11;
+    static constexpr uint64_t SUB_BUCKET_COUNT = 1ull << SUB_BUCKET_BITS;
+    static constexpr uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+    static constexpr int MAX_SHIFT = 40;
+    
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t max_value = 0;
+    double sum = 0;
+    
+    static size_t indexOf(uint64_t value) {
+        if (value < SUB_BUCKET_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        int shift = 63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1);
+        if (shift > MAX_SHIFT) {
+            shift = MAX_SHIFT;
+            value = ((SUB_BUCKET_COUNT - 1) << shift);
+        }
+        uint64_t sub = value >> shift;
+        return static_cast<size_t>(SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF +
+                                   (sub - SUB_BUCKET_HALF));
+    }
+    
+    // Largest value that maps to the same slot as index
+    static uint64_t highestEquivalent(size_t index) {
+        if (index < SUB_BUCKET_COUNT) {
+            return index;
+        }
+        uint64_t offset = index - SUB_BUCKET_COUNT;
+        int shift = static_cast<int>(offset / SUB_BUCKET_HALF) + 1;
+        uint64_t sub = offset % SUB_BUCKET_HALF + SUB_BUCKET_HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+    
+public:
+    Histogram() : counts(SUB_BUCKET_COUNT + MAX_SHIFT * SUB_BUCKET_HALF, 0) {}
+    
+    void record(uint64_t value) {
+        ++counts[indexOf(value)];
+        ++total;
+        sum += static_cast<double>(value);
+        max_value = std::max(max_value, value);
+    }
+    
+    // Adds the samples a closed-loop client missed while it waited on a slow
+    // response, assuming requests were due every expected_interval
+    void recordCorrected(uint64_t value, uint64_t expected_interval) {
+        record(value);
+        if (expected_interval == 0) {
+            return;
+        }
+        for (uint64_t missing = value; missing > expected_interval;) {
+            missing -= expected_interval;
+            record(missing);
+        }
+    }
+    
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        max_value = std::max(max_value, other.max_value);
+    }
+    
+    uint64_t count() const {
+        return total;
+    }
+    
+    double mean() const {
+        return total == 0 ? 0 : sum / static_cast<double>(total);
+    }
+    
+    uint64_t max() const {
+        return max_value;
+    }
+    
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(total)));
+        target = std::max<uint64_t>(target, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= target) {
+                return std::min(highestEquivalent(i), max_value);
+            }
+        }
+        return max_value;
+    }
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    unsigned connections = 64;
+    unsigned threads = 1;
+    unsigned pipeline = 1;
+    bool keep_alive = true;
+    double duration = 10;
+    double warmup = 1;
+    // Total requests per second across all connections; 0 = closed loop
+    double rate = 0;
+    // Closed-loop coordinated omission correction interval, 0 = off
+    uint64_t expected_interval_us = 0;
+    // Request paths, repeated according to their weights
+    std::vector<std::string> paths = {"/"};
+    std::string mix = "/";
+    std::string label;
+    bool json = false;
+};
+
+struct Stats {
+    Histogram latency;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t reconnects = 0;
+    uint64_t bytes = 0;
+    uint64_t status_2xx = 0;
+    uint64_t status_other = 0;
+    
+    void merge(const Stats& other) {
+        latency.merge(other.latency);
+        requests += other.requests;
+        errors += other.errors;
+        reconnects += other.reconnects;
+        bytes += other.bytes;
+        status_2xx += other.status_2xx;
+        status_other += other.status_other;
+    }
+};
+
+// One load generating thread with its own epoll loop and connections
+class Worker {
+private:
+    struct Connection {
+        int fd = -1;
+        bool connected = false;
+        std::string out;
+        size_t out_offset = 0;
+        std::string in;
+        // Start times (intended send times in open-loop mode) of the requests
+        // written but not yet answered, oldest first
+        std::deque<uint64_t> in_flight;
+        // Requests to resend after the server closed the connection
+        std::deque<uint64_t> retry;
+        uint64_t next_send = 0;
+        uint64_t issued = 0;
+        // While fd is -1 after a failed connect, when to try again
+        uint64_t retry_at = 0;
+        uint64_t backoff_ns = 0;
+    };
+    
+    const Options& options;
+    sockaddr_in address;
+    std::vector<Connection> connections;
+    int epoll_fd = -1;
+    uint64_t interval_ns = 0;
+    uint64_t measure_start = 0;
+    uint64_t end_time = 0;
+    // Connections waiting out a backoff
+    size_t backing_off = 0;
+    Stats stats;
+    
+    void connect(size_t index) {
+        Connection& conn = connections[index];
+        conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (conn.fd < 0) {
+            throw std::runtime_error("Socket creation failed");
+        }
+        int opt = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        conn.connected = false;
+        if (::connect(conn.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 &&
+            errno != EINPROGRESS) {
+            ++stats.errors;
+            backOff(index);
+            return;
+        }
+        
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = index;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &ev);
+    }
+    
+    // Closes a connection whose connect failed and schedules the next
+    // attempt, so a refusing server costs one error per attempt rather than
+    // a busy loop of them
+    void backOff(size_t index) {
+        Connection& conn = connections[index];
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+        conn.fd = -1;
+        conn.backoff_ns = std::min(std::max(conn.backoff_ns * 2, MIN_BACKOFF_NS), MAX_BACKOFF_NS);
+        conn.retry_at = nowNs() + conn.backoff_ns;
+        ++backing_off;
+    }
+    
+    // Closes the connection and opens a new one; unanswered requests are
+    // sent again with their original start times
+    void reconnect(size_t index) {
+        Connection& conn = connections[index];
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+        conn.retry.insert(conn.retry.begin(), conn.in_flight.begin(), conn.in_flight.end());
+        conn.in_flight.clear();
+        conn.out.clear();
+        conn.out_offset = 0;
+        conn.in.clear();
+        ++stats.reconnects;
+        connect(index);
+    }
+    
+    void appendRequest(Connection& conn, uint64_t start) {
+        const std::string& path = options.paths[conn.issued++ % options.paths.size()];
+        conn.out += "GET ";
+        conn.out += path;
+        conn.out += " HTTP/1.1\r\nHost: ";
+        conn.out += options.host;
+        conn.out += options.keep_alive ? "\r\nUser-Agent: xweb-loadgen\r\n\r\n"
+                                       : "\r\nUser-Agent: xweb-loadgen\r\nConnection: close\r\n\r\n";
+        conn.in_flight.push_back(start);
+    }
+    
+    // Queues as many requests as the pipeline depth and schedule allow
+    void fillPipeline(Connection& conn, uint64_t now) {
+        unsigned depth = options.keep_alive ? options.pipeline : 1;
+        while (conn.in_flight.size() < depth) {
+            if (!conn.retry.empty()) {
+                appendRequest(conn, conn.retry.front());
+                conn.retry.pop_front();
+            } else if (interval_ns == 0) {
+                appendRequest(conn, now);
+            } else if (conn.next_send <= now) {
+                appendRequest(conn, conn.next_send);
+                conn.next_send += interval_ns;
+            } else {
+                break;
+            }
+        }
+    }
+    
+    bool flush(Connection& conn) {
+        while (conn.out_offset < conn.out.size()) {
+            ssize_t n = send(conn.fd, conn.out.data() + conn.out_offset,
+                             conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.out_offset += static_cast<size_t>(n);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            }
+        }
+        conn.out.clear();
+        conn.out_offset = 0;
+        return true;
+    }
+    
+    static size_t findHeaderValue(const std::string& head, const char* name, size_t name_length) {
+        for (size_t pos = head.find("\r\n"); pos != std::string::npos && pos + 2 < head.size();
+             pos = head.find("\r\n", pos + 2)) {
+            if (strncasecmp(head.c_str() + pos + 2, name, name_length) == 0) {
+                return pos + 2 + name_length;
+            }
+        }
+        return std::string::npos;
+    }
+    
+    // Consumes complete responses from conn.in. Returns false when the
+    // connection must be reopened.
+    bool readResponses(Connection& conn, uint64_t now, bool eof) {
+        while (!conn.in_flight.empty()) {
+            size_t head_end = conn.in.find("\r\n\r\n");
+            if (head_end == std::string::npos) {
+                break;
+            }
+            std::string head = conn.in.substr(0, head_end + 2);
+            if (head.compare(0, 5, "HTTP/") != 0 || head.size() < 12) {
+                ++stats.errors;
+                return false;
+            }
+            
+            size_t length_pos = findHeaderValue(head, "Content-Length:", 15);
+            size_t body_length;
+            if (length_pos != std::string::npos) {
+                body_length = std::strtoul(head.c_str() + length_pos, nullptr, 10);
+            } else if (eof) {
+                body_length = conn.in.size() - head_end - 4;
+            } else {
+                break;
+            }
+            size_t total = head_end + 4 + body_length;
+            if (conn.in.size() < total) {
+                break;
+            }
+            
+            int status = std::atoi(head.c_str() + 9);
+            uint64_t start = conn.in_flight.front();
+            conn.in_flight.pop_front();
+            // Only responses completed inside the measured window count
+            if (now >= measure_start) {
+                uint64_t latency_us = (now - std::min(now, start)) / 1000;
+                stats.latency.recordCorrected(latency_us, options.expected_interval_us);
+                ++stats.requests;
+                stats.bytes += total;
+                if (status >= 200 && status < 300) {
+                    ++stats.status_2xx;
+                } else {
+                    ++stats.status_other;
+                }
+            }
+            
+            size_t close_pos = findHeaderValue(head, "Connection:", 11);
+            bool server_closes = close_pos != std::string::npos &&
+                                 head.find("close", close_pos) < head.find("\r\n", close_pos);
+            conn.in.erase(0, total);
+            if (server_closes || !options.keep_alive) {
+                return false;
+            }
+        }
+        return !eof;
+    }
+    
+    void onEvent(size_t index, uint32_t events, uint64_t now) {
+        Connection& conn = connections[index];
+        if (events & EPOLLERR) {
+            ++stats.errors;
+            if (conn.connected) {
+                reconnect(index);
+            } else {
+                backOff(index);
+            }
+            return;
+        }
+        if (!conn.connected && (events & EPOLLOUT)) {
+            conn.connected = true;
+            conn.backoff_ns = 0;
+        }
+        
+        bool eof = false;
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+            char buffer[65536];
+            while (true) {
+                ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    conn.in.append(buffer, static_cast<size_t>(n));
+                } else if (n == 0) {
+                    eof = true;
+                    break;
+                } else if (errno == EINTR) {
+                    continue;
+                } else {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        eof = true;
+                        if (conn.in_flight.empty() || conn.in.empty()) {
+                            ++stats.errors;
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        
+        if (!readResponses(conn, now, eof)) {
+            reconnect(index);
+            return;
+        }
+        pump(conn);
+    }
+    
+    void pump(Connection& conn) {
+        if (!conn.connected) {
+            return;
+        }
+        fillPipeline(conn, nowNs());
+        flush(conn);
+    }
+    
+public:
+    Worker(const Options& options, unsigned connection_count)
+        : options(options), connections(connection_count) {
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+            throw std::invalid_argument("Host must be an IPv4 address: " + options.host);
+        }
+        if (options.rate > 0) {
+            interval_ns = static_cast<uint64_t>(1e9 * options.connections / options.rate);
+        }
+    }
+    
+    ~Worker() {
+        for (Connection& conn : connections) {
+            if (conn.fd >= 0) {
+                close(conn.fd);
+            }
+        }
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+    }
+    
+    const Stats& result() const {
+        return stats;
+    }
+    
+    void run(uint64_t start_time) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            throw std::runtime_error("epoll_create1 failed");
+        }
+        measure_start = start_time + static_cast<uint64_t>(options.warmup * 1e9);
+        end_time = measure_start + static_cast<uint64_t>(options.duration * 1e9);
+        
+        for (size_t i = 0; i < connections.size(); ++i) {
+            // Stagger the open-loop schedules so connections do not fire together
+            connections[i].next_send = start_time + interval_ns * i / connections.size();
+            connect(i);
+        }
+        
+        epoll_event events[MAX_EVENTS];
+        while (true) {
+            uint64_t now = nowNs();
+            if (now >= end_time) {
+                break;
+            }
+            
+            int timeout_ms = 10;
+            if (interval_ns != 0 || backing_off != 0) {
+                uint64_t next = end_time;
+                for (const Connection& conn : connections) {
+                    next = std::min(next, conn.fd < 0 ? conn.retry_at : interval_ns != 0 ? conn.next_send : end_time);
+                }
+                timeout_ms = next <= now ? 0 : static_cast<int>(std::min<uint64_t>((next - now) / 1000000, 10));
+            }
+            
+            int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+            now = nowNs();
+            for (int i = 0; i < count; ++i) {
+                onEvent(static_cast<size_t>(events[i].data.u64), events[i].events, now);
+            }
+            for (size_t i = 0; i < connections.size() && backing_off != 0; ++i) {
+                if (connections[i].fd < 0 && connections[i].retry_at <= now) {
+                    --backing_off;
+                    connect(i);
+                }
+            }
+            if (interval_ns != 0) {
+                for (Connection& conn : connections) {
+                    if (conn.next_send <= now) {
+                        pump(conn);
+                    }
+                }
+            }
+        }
+    }
+};
+
+void usage() {
+    std::cerr << "Usage: loadgen [options]\n"
+              << "  --host ADDR          IPv4 address (default 127.0.0.1)\n"
+              << "  --port N             port (default 8080)\n"
+              << "  -c, --connections N  concurrent connections (default 64)\n"
+              << "  -t, --threads N      load generating threads (default 1)\n"
+              << "  -d, --duration S     measured seconds (default 10)\n"
+              << "  --warmup S           unmeasured seconds before that (default 1)\n"
+              << "  --pipeline N         requests in flight per connection (default 1)\n"
+              << "  --close              one request per connection (Connection: close)\n"
+              << "  --rate R             open loop at R requests/s in total (default: closed loop)\n"
+              << "  --expected-interval-us N\n"
+              << "                       closed-loop coordinated omission correction\n"
+              << "  --mix PATH[:W],...   weighted request paths (default /)\n"
+              << "  --label NAME         name reported in the JSON output\n"
+              << "  --json               print one JSON object instead of text\n";
+}
+
+std::vector<std::string> parseMix(const std::string& mix) {
+    std::vector<std::string> paths;
+    std::istringstream entries(mix);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        size_t colon = entry.rfind(':');
+        unsigned weight = 1;
+        if (colon != std::string::npos) {
+            weight = static_cast<unsigned>(std::stoul(entry.substr(colon + 1)));
+            entry.erase(colon);
+        }
+        if (entry.empty() || entry.front() != '/') {
+            throw std::invalid_argument("Mix paths must start with '/': " + entry);
+        }
+        // Each path appears weight times; requests cycle through the list
+        for (unsigned i = 0; i < weight; ++i) {
+            paths.push_back(entry);
+        }
+    }
+    if (paths.empty()) {
+        throw std::invalid_argument("Empty request mix");
+    }
+    return paths;
+}
+
+Options parseArguments(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--host" && has_value) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            options.port = std::stoi(argv[++i]);
+        } else if ((arg == "-c" || arg == "--connections") && has_value) {
+            options.connections = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if ((arg == "-t" || arg == "--threads") && has_value) {
+            options.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if ((arg == "-d" || arg == "--duration") && has_value) {
+            options.duration = std::stod(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup = std::stod(argv[++i]);
+        } else if (arg == "--pipeline" && has_value) {
+            options.pipeline = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--close") {
+            options.keep_alive = false;
+        } else if (arg == "--rate" && has_value) {
+            options.rate = std::stod(argv[++i]);
+        } else if (arg == "--expected-interval-us" && has_value) {
+            options.expected_interval_us = std::stoull(argv[++i]);
+        } else if (arg == "--mix" && has_value) {
+            options.mix = argv[++i];
+            options.paths = parseMix(options.mix);
+        } else if (arg == "--label" && has_value) {
+            options.label = argv[++i];
+        } else if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            std::exit(0);
+        } else {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
+    }
+    
+    options.threads = std::max(1u, options.threads);
+    options.connections = std::max(options.connections, options.threads);
+    options.pipeline = std::max(1u, options.pipeline);
+    return options;
+}
+
+std::string jsonEscape(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void report(const Options& options, const Stats& stats) {
+    const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+    const char* names[] = {"p50", "p90", "p99", "p99.9", "p99.99"};
+    double throughput = static_cast<double>(stats.requests) / options.duration;
+    
+    if (options.json) {
+        std::cout << std::fixed << std::setprecision(1)
+                  << "{\"label\":\"" << jsonEscape(options.label) << "\""
+                  << ",\"target\":\"" << options.host << ":" << options.port << "\""
+                  << ",\"mix\":\"" << jsonEscape(options.mix) << "\""
+                  << ",\"mode\":\"" << (options.rate > 0 ? "open" : "closed") << "\""
+                  << ",\"rate\":" << options.rate
+                  << ",\"connections\":" << options.connections
+                  << ",\"threads\":" << options.threads
+                  << ",\"pipeline\":" << (options.keep_alive ? options.pipeline : 1)
+                  << ",\"keep_alive\":" << (options.keep_alive ? "true" : "false")
+                  << ",\"duration_s\":" << options.duration
+                  << ",\"requests\":" << stats.requests
+                  << ",\"throughput_rps\":" << throughput
+                  << ",\"bytes_per_s\":" << static_cast<double>(stats.bytes) / options.duration
+                  << ",\"non_2xx\":" << stats.status_other
+                  << ",\"errors\":" << stats.errors
+                  << ",\"reconnects\":" << stats.reconnects
+                  << ",\"latency_us\":{\"mean\":" << stats.latency.mean();
+        for (size_t i = 0; i < 5; ++i) {
+            std::cout << ",\"" << names[i] << "\":" << stats.latency.percentile(percentiles[i]);
+        }
+        std::cout << ",\"max\":" << stats.latency.max() << "}}" << std::endl;
+        return;
+    }
+    
+    std::cout << "Target:     " << options.host << ":" << options.port << " mix " << options.mix << "\n"
+              << "Mode:       " << (options.rate > 0 ? "open loop" : "closed loop") << ", "
+              << options.connections << " connections, " << options.threads << " threads, "
+              << (options.keep_alive ? "keep-alive, pipeline " + std::to_string(options.pipeline)
+                                     : std::string("connection per request")) << "\n"
+              << std::fixed << std::setprecision(1)
+              << "Requests:   " << stats.requests << " in " << options.duration << "s ("
+              << throughput << " req/s, " << stats.bytes / options.duration / 1e6 << " MB/s)\n"
+              << "Non-2xx:    " << stats.status_other << ", errors " << stats.errors
+              << ", reconnects " << stats.reconnects << "\n"
+              << "Latency us: mean " << stats.latency.mean();
+    for (size_t i = 0; i < 5; ++i) {
+        std::cout << "  " << names[i] << " " << stats.latency.percentile(percentiles[i]);
+    }
+    std::cout << "  max " << stats.latency.max() << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseArguments(argc, argv);
+        
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (unsigned i = 0; i < options.threads; ++i) {
+            unsigned share = options.connections / options.threads +
+                             (i < options.connections % options.threads ? 1 : 0);
+            workers.emplace_back(new Worker(options, share));
+        }
+        
+        uint64_t start_time = nowNs();
+        std::vector<std::thread> threads;
+        for (auto& worker : workers) {
+            Worker* w = worker.get();
+            threads.emplace_back([w, start_time]() {
+                try {
+                    w->run(start_time);
+                } catch (const std::exception& e) {
+                    std::cerr << "Worker error: " << e.what() << std::endl;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        
+        Stats total;
+        for (auto& worker : workers) {
+            total.merge(worker->result());
+        }
+        report(options, total);
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,135 @@
+#!/usr/bin/env bash
+# Benchmarks the C and C++ servers on loopback with the bundled load
+# generator and writes one JSON report covering every server/scenario pair.
+#
+# Usage: BENCH/run.sh [report.json]
+#
+# Environment:
+#   DURATION     measured seconds per scenario (default 10)
+#   WARMUP       unmeasured seconds before each scenario (default 2)
+#   CONNECTIONS  concurrent connections (default 64)
+#   THREADS      load generator threads (default 2)
+#   RATE         open-loop request rate for the constant-rate scenario (default 20000)
+#   SERVERS      servers to run (default "c cpp")
+#   CPP_ARGS     extra options for the C++ server, e.g. "--defer-accept 1"
+#                to measure a socket option against a BASELINE run without it
+#   BASELINE     previous report; fail if throughput or p99 regress by more
+#                than THRESHOLD percent (default 10)
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+OUTPUT="${1:-bench_report.json}"
+BUILD="${BUILD:-$(mktemp -d)}"
+DURATION="${DURATION:-10}"
+WARMUP="${WARMUP:-2}"
+CONNECTIONS="${CONNECTIONS:-64}"
+THREADS="${THREADS:-2}"
+RATE="${RATE:-20000}"
+SERVERS="${SERVERS:-c cpp}"
+CPP_ARGS="${CPP_ARGS:-}"
+THRESHOLD="${THRESHOLD:-10}"
+PORT=8080
+
+# name|loadgen arguments
+SCENARIOS=(
+    "html-close|--close --mix /"
+    "api-close|--close --mix /api"
+    "html-keepalive|--mix /"
+    "api-keepalive|--mix /api"
+    "mixed-keepalive|--mix /:1,/api:1"
+    "api-pipeline16|--pipeline 16 --mix /api"
+    "api-constant-rate|--rate $RATE --mix /api"
+)
+
+echo "Building into $BUILD"
+gcc -O2 "$ROOT/C/webserver.c" -o "$BUILD/webserver-c"
+g++ -std=c++17 -O2 -pthread "$ROOT/CPP/webserver.cpp" -o "$BUILD/webserver-cpp" -lz
+g++ -std=c++17 -O2 -pthread "$ROOT/BENCH/loadgen.cpp" -o "$BUILD/loadgen"
+
+SERVER_PID=""
+stop_server() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+        SERVER_PID=""
+    fi
+}
+trap stop_server EXIT
+
+# Starts a server and waits until it accepts connections. The C server does
+# not set SO_REUSEADDR, so binding can fail while sockets from the previous
+# run sit in TIME_WAIT; keep retrying for a minute.
+start_server() {
+    local binary="$1"
+    shift
+    for _ in $(seq 1 120); do
+        "$binary" "$@" >/dev/null 2>&1 &
+        SERVER_PID=$!
+        for _ in $(seq 1 20); do
+            if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+                break
+            fi
+            if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+                return 0
+            fi
+            sleep 0.05
+        done
+        stop_server
+        sleep 0.5
+    done
+    echo "Could not start $binary on port $PORT" >&2
+    return 1
+}
+
+RESULTS=()
+for server in $SERVERS; do
+    echo "== $server"
+    server_args=()
+    if [ "$server" = cpp ] && [ -n "$CPP_ARGS" ]; then
+        read -ra server_args <<< "$CPP_ARGS"
+    fi
+    start_server "$BUILD/webserver-$server" ${server_args[@]+"${server_args[@]}"}
+    for scenario in "${SCENARIOS[@]}"; do
+        name="${scenario%%|*}"
+        args="${scenario#*|}"
+        # shellcheck disable=SC2086
+        result="$("$BUILD/loadgen" --port "$PORT" -c "$CONNECTIONS" -t "$THREADS" \
+            -d "$DURATION" --warmup "$WARMUP" --label "$server/$name" --json $args)"
+        echo "$result"
+        RESULTS+=("$result")
+    done
+    stop_server
+done
+
+{
+    printf '{"generated":"%s","host":"%s","duration_s":%s,"results":[\n' \
+        "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -n)" "$DURATION"
+    for i in "${!RESULTS[@]}"; do
+        [ "$i" -gt 0 ] && printf ',\n'
+        printf '%s' "${RESULTS[$i]}"
+    done
+    printf '\n]}\n'
+} > "$OUTPUT"
+echo "Report written to $OUTPUT"
+
+if [ -n "${BASELINE:-}" ]; then
+    python3 - "$BASELINE" "$OUTPUT" "$THRESHOLD" <<'EOF'
+import json
+import sys
+
+baseline, current, threshold = sys.argv[1], sys.argv[2], float(sys.argv[3])
+old = {r["label"]: r for r in json.load(open(baseline))["results"]}
+failed = False
+for result in json.load(open(current))["results"]:
+    before = old.get(result["label"])
+    if before is None:
+        continue
+    throughput = 100.0 * (result["throughput_rps"] / max(before["throughput_rps"], 1) - 1)
+    p99 = 100.0 * (result["latency_us"]["p99"] / max(before["latency_us"]["p99"], 1) - 1)
+    regressed = throughput < -threshold or p99 > threshold
+    failed = failed or regressed
+    print("%-28s throughput %+6.1f%%  p99 %+6.1f%%%s"
+          % (result["label"], throughput, p99, "  REGRESSION" if regressed else ""))
+sys.exit(1 if failed else 0)
+EOF
+fi
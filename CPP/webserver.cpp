@@ -1,10 +1,31 @@
 #include <iostream>
 #include <string>
 #include <sstream>
-#include <chrono>
 #include <iomanip>
+#include <chrono>
 #include <cstring>
 #include <ctime>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+#include <string_view>
+#include <cctype>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <charconv>
+#include <type_traits>
+#include <functional>
+#include <fstream>
+#include <cerrno>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -13,300 +34,6233 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define XWEB_X86_SIMD 1
+#include <immintrin.h>
+#include <x86intrin.h>
+#else
+#define XWEB_X86_SIMD 0
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <signal.h>
+#include <poll.h>
+#include <climits>
+#include <linux/filter.h>
+#include <linux/mempolicy.h>
+#endif
+
+// io_uring with provided buffer rings and multishot accept (Linux 5.19+
+// headers); used without liburing
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+// Response compression: gzip is built in and needs -lz, unless the build
+// defines XWEB_NO_GZIP; brotli is optional, with -DXWEB_BROTLI -lbrotlienc
+#if !defined(XWEB_NO_GZIP) && !defined(XWEB_GZIP)
+#define XWEB_GZIP 1
+#endif
+#ifdef XWEB_GZIP
+#include <zlib.h>
+#endif
+#ifdef XWEB_BROTLI
+#include <brotli/encode.h>
+#endif
+#if defined(__linux__) && defined(IORING_ACCEPT_MULTISHOT)
+#define XWEB_IO_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#else
+#define XWEB_IO_URING 0
 #endif
 
 constexpr int PORT = 8080;
 constexpr int BUFFER_SIZE = 1024;
+constexpr int MAX_EVENTS = 256;
+constexpr size_t MAX_REQUEST_SIZE = 8192;
+// Segments per gather write; a pipelined batch larger than this is sent by
+// several calls
+constexpr size_t MAX_IOVECS = 64;
 
-class WebServer {
-private:
-    int server_fd;
-    struct sockaddr_in server_addr;
-    
-#ifdef _WIN32
-    WSADATA wsa_data;
+// A peer that hung up must not kill the process with SIGPIPE
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
 #endif
 
-    std::string getCurrentDateTime() const {
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-        return ss.str();
+struct ParserLimits {
+    size_t max_request_line = MAX_REQUEST_SIZE;
+    // Request line plus all header lines
+    size_t max_header_bytes = MAX_REQUEST_SIZE;
+    size_t max_headers = 64;
+    size_t max_body = 1024 * 1024;
+};
+
+// Options set on the listening socket. Accepted sockets inherit them, so
+// they cost no system calls per connection. 0 leaves the kernel default.
+struct SocketOptions {
+    // Send small responses at once instead of waiting for the peer's ACK
+    bool tcp_nodelay = true;
+    // Seconds the kernel holds a connection that has sent no data before
+    // reporting it to accept() (Linux TCP_DEFER_ACCEPT)
+    int defer_accept = 0;
+    // Pending TCP Fast Open requests; lets repeat clients send the request
+    // in the SYN (Linux TCP_FASTOPEN)
+    int fastopen_queue = 0;
+    // SO_SNDBUF and SO_RCVBUF in bytes; setting one disables the kernel's
+    // autotuning of that buffer
+    int send_buffer = 0;
+    int receive_buffer = 0;
+    // Unsent bytes above which the socket stops reporting writable
+    // (Linux TCP_NOTSENT_LOWAT)
+    int notsent_lowat = 0;
+    // Microseconds to busy-poll the device queue on a blocking read
+    // (Linux SO_BUSY_POLL; raising it needs CAP_NET_ADMIN)
+    int busy_poll = 0;
+};
+
+struct ServerConfig {
+    // Number of event loops; each gets its own SO_REUSEPORT listener.
+    // 0 means one per hardware thread.
+    unsigned workers = 0;
+    // System call interface of the event loops (Linux). io_uring falls back
+    // to epoll when the kernel does not support it.
+    enum class IoBackend { Epoll, IoUring };
+    IoBackend io_backend = IoBackend::Epoll;
+    // Length of the kernel's queue of connections not yet accepted;
+    // 0 uses net.core.somaxconn, the most the kernel allows
+    int listen_backlog = 0;
+    // All event loops share one listener and are woken one at a time with
+    // EPOLLEXCLUSIVE, instead of one SO_REUSEPORT listener each (Linux)
+    bool shared_listener = false;
+    SocketOptions socket_options;
+    // CPUs to pin the event loops to, as a list like "0-3,8,10-11" or
+    // "auto" for every CPU the process may run on; worker i gets the i-th
+    // CPU. Empty leaves placement to the scheduler (Linux).
+    std::string cpu_affinity;
+    // Seconds an idle keep-alive connection is kept open
+    unsigned keep_alive_timeout = 5;
+    // Seconds to receive a request's header block once its first byte
+    // arrived, and then its body; neither is extended by slow trickles
+    unsigned header_timeout = 10;
+    unsigned body_timeout = 30;
+    // Seconds a response may go without the client accepting more bytes
+    unsigned write_timeout = 30;
+    // Requests served on one connection before it is closed (0 = unlimited)
+    unsigned max_keep_alive_requests = 100;
+    ParserLimits limits;
+    // Serve files from this directory (Linux only); empty disables it
+    std::string document_root;
+    // Entries in each worker's open file cache
+    size_t file_cache_size = 1024;
+    
+    // What the pool's acceptor does when the hand-off queue is full
+    enum class Overflow { Reject, Block };
+    // Threads in the worker pool; 0 runs the per-core event loops instead
+    unsigned pool_threads = 0;
+    // Accepted connections waiting for a pool thread
+    size_t pool_queue_depth = 1024;
+    Overflow pool_overflow = Overflow::Reject;
+    
+    // Cache-Control value per route; empty omits the header
+    std::string page_cache_control = "no-cache";
+    std::string api_cache_control = "no-store";
+    std::string file_cache_control = "no-cache";
+    
+    // Access log file; empty disables logging
+    std::string access_log_path;
+    enum class LogFormat { Common, Combined, Json };
+    LogFormat access_log_format = LogFormat::Combined;
+    // Records each request thread can queue before new ones are dropped
+    size_t access_log_buffer = 2048;
+    // Rotate to <path>.1 once the file reaches this size (0 = never)
+    uint64_t access_log_rotate_size = 0;
+};
+
+// Bump allocator for memory that lives as long as one request. Allocation
+// is a pointer increment in the current chunk; reset() rewinds to the first
+// chunk in O(1) and keeps every chunk, so once a connection has seen its
+// largest request it stops calling malloc. Nothing is destroyed on reset:
+// only trivially destructible data, or containers that are gone by then,
+// may live here.
+class Arena {
+public:
+    explicit Arena(size_t chunk_size = 4096) : chunk_size(chunk_size) {}
+    
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        while (current < chunks.size()) {
+            Chunk& chunk = chunks[current];
+            size_t offset = (used + alignment - 1) & ~(alignment - 1);
+            if (offset + size <= chunk.size) {
+                used = offset + size;
+                return chunk.data.get() + offset;
+            }
+            ++current;
+            used = 0;
+        }
+        // Chunks come from new[] and are aligned for any fundamental type
+        size_t size_needed = std::max(chunk_size, size);
+        chunks.push_back(Chunk{std::unique_ptr<char[]>(new char[size_needed]), size_needed});
+        used = size;
+        return chunks.back().data.get();
     }
     
-    long getCurrentTimestamp() const {
-        auto now = std::chrono::system_clock::now();
-        return std::chrono::duration_cast<std::chrono::seconds>(
-            now.time_since_epoch()).count();
+    template <typename T>
+    T* allocateArray(size_t count) {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
     }
     
-    std::string createHtmlResponse() const {
-        std::ostringstream html;
-        html << "<!DOCTYPE html>"
-             << "<html lang=\"en\">"
-             << "<head>"
-             << "<meta charset=\"UTF-8\">"
-             << "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">"
-             << "<title>C++ Web Server</title>"
-             << "<style>"
-             << "body {"
-             << "font-family: 'Segoe UI', Tahoma, Geneva, Verdana, sans-serif;"
-             << "margin: 0; padding: 40px;"
-             << "background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);"
-             << "min-height: 100vh; color: #333;"
-             << "}"
-             << ".container {"
-             << "max-width: 900px; margin: 0 auto; background-color: white;"
-             << "padding: 40px; border-radius: 15px;"
-             << "box-shadow: 0 10px 30px rgba(0,0,0,0.2);"
-             << "}"
-             << "h1 {"
-             << "color: #2c3e50; text-align: center; margin-bottom: 10px;"
-             << "font-size: 2.5em; font-weight: 300;"
-             << "}"
-             << ".language-badge {"
-             << "display: inline-block;"
-             << "background: linear-gradient(45deg, #00599c, #004482);"
-             << "color: white; padding: 8px 16px; border-radius: 25px;"
-             << "font-size: 0.9em; font-weight: bold; margin-left: 10px;"
-             << "box-shadow: 0 2px 10px rgba(0,0,0,0.2);"
-             << "}"
-             << "h2 {"
-             << "color: #34495e; border-bottom: 3px solid #3498db;"
-             << "padding-bottom: 10px; margin-top: 40px;"
-             << "}"
-             << ".info-grid {"
-             << "display: grid; grid-template-columns: auto 1fr;"
-             << "gap: 15px 25px; margin: 25px 0;"
-             << "background: linear-gradient(135deg, #f8f9fa, #e9ecef);"
-             << "padding: 25px; border-radius: 10px;"
-             << "border-left: 5px solid #3498db;"
-             << "}"
-             << ".info-label { font-weight: bold; color: #2c3e50; }"
-             << ".info-value { color: #34495e; }"
-             << "a {"
-             << "color: #3498db; text-decoration: none; font-weight: 500;"
-             << "transition: all 0.3s ease;"
-             << "}"
-             << "a:hover { color: #2980b9; text-decoration: underline; }"
-             << "#browser {"
-             << "background: linear-gradient(135deg, #e8f4f8, #d1ecf1);"
-             << "padding: 20px; border-radius: 10px; margin-top: 15px;"
-             << "border-left: 5px solid #17a2b8;"
-             << "font-family: 'Courier New', monospace; font-size: 0.9em;"
-             << "}"
-             << ".footer {"
-             << "text-align: center; margin-top: 40px; padding-top: 20px;"
-             << "border-top: 1px solid #dee2e6; color: #6c757d; font-size: 0.9em;"
-             << "}"
-             << "</style>"
-             << "</head>"
-             << "<body>"
-             << "<div class=\"container\">"
-             << "<h1>Hello, World! <span class=\"language-badge\">C++</span></h1>"
-             << "<h2>Server Information</h2>"
-             << "<div class=\"info-grid\">"
-             << "<span class=\"info-label\">Port:</span>"
-             << "<span class=\"info-value\">" << PORT << "</span>"
-             << "<span class=\"info-label\">Platform:</span>"
-#ifdef _WIN32
-             << "<span class=\"info-value\">Windows</span>"
-#else
-             << "<span class=\"info-value\">Linux/Unix</span>"
-#endif
-             << "<span class=\"info-label\">API Endpoint:</span>"
-             << "<span class=\"info-value\"><a href='/api'>/api</a></span>"
-             << "</div>"
-             << "<h2>Browser Information</h2>"
-             << "<div id='browser'><em>JavaScript required to display browser information</em></div>"
-             << "<div class=\"footer\">"
-             << "<p>Multi-Language Web Server Collection | C++ Implementation</p>"
-             << "</div>"
-             << "</div>"
-             << "<script>"
-             << "const browserInfo = document.getElementById('browser');"
-             << "const info = ["
-             << "'<strong>User-Agent:</strong> ' + navigator.userAgent,"
-             << "'<strong>Platform:</strong> ' + navigator.platform,"
-             << "'<strong>Language:</strong> ' + navigator.language,"
-             << "'<strong>Languages:</strong> ' + navigator.languages.join(', '),"
-             << "'<strong>Cookies enabled:</strong> ' + navigator.cookieEnabled,"
-             << "'<strong>Screen resolution:</strong> ' + screen.width + 'x' + screen.height,"
-             << "'<strong>Color depth:</strong> ' + screen.colorDepth + ' bits',"
-             << "'<strong>Timezone:</strong> ' + Intl.DateTimeFormat().resolvedOptions().timeZone,"
-             << "'<strong>Online status:</strong> ' + (navigator.onLine ? 'Online' : 'Offline'),"
-             << "'<strong>Hardware concurrency:</strong> ' + (navigator.hardwareConcurrency || 'Unknown') + ' cores'"
-             << "];"
-             << "browserInfo.innerHTML = info.join('<br>');"
-             << "</script>"
-             << "</body></html>";
-        
-        std::string body = html.str();
-        std::ostringstream response;
-        response << "HTTP/1.1 200 OK\r\n"
-                 << "Content-Type: text/html\r\n"
-                 << "Connection: close\r\n"
-                 << "Content-Length: " << body.length() << "\r\n"
-                 << "\r\n"
-                 << body;
-        
-        return response.str();
+    void reset() {
+        current = 0;
+        used = 0;
     }
     
-    std::string createApiResponse() const {
-        std::ostringstream json;
-        json << "{"
-             << "\"server_info\":{"
-             << "\"port\":" << PORT << ","
-#ifdef _WIN32
-             << "\"platform\":\"win32\","
-             << "\"os\":\"Windows\","
-#else
-             << "\"platform\":\"unix\","
-             << "\"os\":\"Linux/Unix\","
-#endif
-             << "\"datetime\":\"" << getCurrentDateTime() << "\","
-             << "\"timestamp\":" << getCurrentTimestamp() << ","
-             << "\"status\":\"running\","
-             << "\"language\":\"cpp\""
-             << "},"
-             << "\"message\":\"Server API endpoint\""
-             << "}";
-        
-        std::string body = json.str();
-        std::ostringstream response;
-        response << "HTTP/1.1 200 OK\r\n"
-                 << "Content-Type: application/json\r\n"
-                 << "Connection: close\r\n"
-                 << "Content-Length: " << body.length() << "\r\n"
-                 << "\r\n"
-                 << body;
-        
-        return response.str();
+    // Frees all chunks but the first, after a request much larger than usual
+    void trim() {
+        reset();
+        if (chunks.size() > 1) {
+            chunks.resize(1);
+        }
     }
+    
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Chunk& chunk : chunks) {
+            total += chunk.size;
+        }
+        return total;
+    }
+    
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+    
+    std::vector<Chunk> chunks;
+    size_t chunk_size;
+    size_t current = 0;
+    // Bytes taken from chunks[current]
+    size_t used = 0;
+};
 
+// Standard allocator over an Arena for request-scoped containers.
+// deallocate() is a no-op; the memory comes back on Arena::reset().
+template <typename T>
+class ArenaAllocator {
 public:
-    WebServer() : server_fd(-1) {
-#ifdef _WIN32
-        if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
-            throw std::runtime_error("WSAStartup failed");
-        }
-#endif
+    using value_type = T;
+    
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+    
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    
+    T* allocate(size_t count) {
+        return arena->allocateArray<T>(count);
     }
     
-    ~WebServer() {
-        stop();
-#ifdef _WIN32
-        WSACleanup();
-#endif
+    void deallocate(T*, size_t) {}
+    
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
     }
     
-    bool start() {
-        // Create socket
-        server_fd = socket(AF_INET, SOCK_STREAM, 0);
-        if (server_fd < 0) {
-            std::cerr << "Socket creation failed" << std::endl;
-            return false;
-        }
-        
-        // Set socket options
-        int opt = 1;
-        if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, 
-                      reinterpret_cast<char*>(&opt), sizeof(opt)) < 0) {
-            std::cerr << "Setsockopt failed" << std::endl;
-            return false;
-        }
-        
-        // Configure server address
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(PORT);
-        
-        // Bind socket
-        if (bind(server_fd, reinterpret_cast<struct sockaddr*>(&server_addr), 
-                sizeof(server_addr)) < 0) {
-            std::cerr << "Bind failed" << std::endl;
-            return false;
-        }
-        
-        // Listen for connections
-        if (listen(server_fd, 3) < 0) {
-            std::cerr << "Listen failed" << std::endl;
-            return false;
-        }
-        
-        std::cout << "Web server started on port " << PORT << std::endl;
-        return true;
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
     }
     
-    void run() {
-        while (true) {
-            struct sockaddr_in client_addr;
-#ifdef _WIN32
-            int client_len = sizeof(client_addr);
-#else
-            socklen_t client_len = sizeof(client_addr);
-#endif
-            
-            int client_fd = accept(server_fd, 
-                                 reinterpret_cast<struct sockaddr*>(&client_addr), 
-                                 &client_len);
-            
-            if (client_fd < 0) {
-                std::cerr << "Accept failed" << std::endl;
-                continue;
-            }
-            
-            handleClient(client_fd);
-            
-#ifdef _WIN32
-            closesocket(client_fd);
-#else
-            close(client_fd);
-#endif
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+    
+    Arena* arena;
+};
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// Idle arenas of one event loop, handed to new connections so that a
+// connection does not start with an empty arena
+class ArenaPool {
+public:
+    std::unique_ptr<Arena> acquire() {
+        if (idle.empty()) {
+            return std::unique_ptr<Arena>(new Arena());
         }
+        std::unique_ptr<Arena> arena = std::move(idle.back());
+        idle.pop_back();
+        return arena;
     }
     
-private:
-    void handleClient(int client_fd) {
-        char buffer[BUFFER_SIZE];
-        int bytes_received = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_received <= 0) {
+    void release(std::unique_ptr<Arena> arena) {
+        if (!arena || idle.size() >= MAX_IDLE) {
             return;
         }
-        
-        buffer[bytes_received] = '\0';
-        std::string request(buffer);
-        
-        std::string response;
-        if (request.find("GET /api") == 0) {
-            response = createApiResponse();
-        } else {
-            response = createHtmlResponse();
+        if (arena->capacity() > MAX_RETAINED_BYTES) {
+            arena->trim();
         }
-        
-        send(client_fd, response.c_str(), response.length(), 0);
+        arena->reset();
+        idle.push_back(std::move(arena));
     }
     
-    void stop() {
-        if (server_fd >= 0) {
-#ifdef _WIN32
-            closesocket(server_fd);
-#else
-            close(server_fd);
-#endif
-            server_fd = -1;
-        }
-    }
+private:
+    static constexpr size_t MAX_IDLE = 1024;
+    static constexpr size_t MAX_RETAINED_BYTES = 64 * 1024;
+    
+    std::vector<std::unique_ptr<Arena>> idle;
 };
 
-int main() {
-    try {
-        WebServer server;
+// Appends the decimal form of an integer without locale or allocation
+template <typename String, typename Integer>
+void appendDecimal(String& out, Integer value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// A parsed request. All views point into the connection's receive buffer and
+// stay valid until the request's bytes are consumed from it.
+struct HttpRequest {
+    std::string_view method;
+    std::string_view target;
+    int minor_version = 1;
+    bool keep_alive = true;
+    size_t content_length = 0;
+    // Header fields in request order, in the arena passed to the parser
+    const HttpHeader* headers = nullptr;
+    size_t header_count = 0;
+    std::string_view body;
+    // Bytes of the buffer taken by this request (head and body)
+    size_t length = 0;
+    
+    std::string_view header(std::string_view name) const;
+};
+
+namespace {
+
+constexpr char toLowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (toLowerAscii(a[i]) != toLowerAscii(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trimWhitespace(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// Character classes from RFC 9110: tchar for methods and header names, and
+// the bytes allowed inside a request or header line (everything but CTLs
+// other than HTAB). The first byte outside `value` must be the line's CR.
+struct CharClasses {
+    bool token[256] = {};
+    bool value[256] = {};
+    
+    constexpr CharClasses() {
+        const char* extra = "!#$%&'*+-.^_`|~";
+        for (int c = 0; c < 256; ++c) {
+            bool alnum = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+            token[c] = alnum;
+            for (const char* e = extra; *e; ++e) {
+                token[c] = token[c] || c == *e;
+            }
+            value[c] = (c >= 0x20 && c != 0x7f) || c == '\t';
+        }
+    }
+};
+
+constexpr CharClasses CHAR_CLASSES;
+
+const char* findDelimiterScalar(const char* p, const char* end) {
+    while (p < end && CHAR_CLASSES.value[static_cast<unsigned char>(*p)]) {
+        ++p;
+    }
+    return p;
+}
+
+const char* scanTokenScalar(const char* p, const char* end) {
+    while (p < end && CHAR_CLASSES.token[static_cast<unsigned char>(*p)]) {
+        ++p;
+    }
+    return p;
+}
+
+#if XWEB_X86_SIMD
+// Nibble lookup tables for classifying tchar with pshufb: byte c is a token
+// character when (lo[c & 0xf] & hi[c >> 4]) != 0. Each row bit of lo marks a
+// high nibble 0-7; high nibbles 8-15 map to 0 since tchar is ASCII only.
+// Both 128-bit lanes hold the same tables for vpshufb.
+struct TokenNibbleTables {
+    alignas(32) unsigned char lo[32] = {};
+    alignas(32) unsigned char hi[32] = {};
+    
+    constexpr TokenNibbleTables() {
+        for (int c = 0; c < 128; ++c) {
+            if (CHAR_CLASSES.token[c]) {
+                lo[c & 0xf] |= static_cast<unsigned char>(1 << (c >> 4));
+                lo[16 + (c & 0xf)] |= static_cast<unsigned char>(1 << (c >> 4));
+            }
+        }
+        for (int h = 0; h < 8; ++h) {
+            hi[h] = static_cast<unsigned char>(1 << h);
+            hi[16 + h] = static_cast<unsigned char>(1 << h);
+        }
+    }
+};
+
+constexpr TokenNibbleTables TOKEN_TABLES;
+
+__attribute__((target("sse4.2")))
+const char* findDelimiterSse42(const char* p, const char* end) {
+    // Byte ranges that end or invalidate a line: 0x00-0x08, 0x0a-0x1f, 0x7f
+    alignas(16) static const char ranges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+    const __m128i delimiters = _mm_load_si128(reinterpret_cast<const __m128i*>(ranges));
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(delimiters, 6, chunk, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (index != 16) {
+            return p + index;
+        }
+        p += 16;
+    }
+    return findDelimiterScalar(p, end);
+}
+
+__attribute__((target("sse4.2")))
+const char* scanTokenSse42(const char* p, const char* end) {
+    const __m128i lo_table = _mm_load_si128(reinterpret_cast<const __m128i*>(TOKEN_TABLES.lo));
+    const __m128i hi_table = _mm_load_si128(reinterpret_cast<const __m128i*>(TOKEN_TABLES.hi));
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i lo_bits = _mm_shuffle_epi8(lo_table, _mm_and_si128(chunk, nibble_mask));
+        __m128i hi_bits = _mm_shuffle_epi8(
+            hi_table, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble_mask));
+        __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(lo_bits, hi_bits), zero);
+        int mask = _mm_movemask_epi8(invalid);
+        if (mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+        p += 16;
+    }
+    return scanTokenScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* findDelimiterAvx2(const char* p, const char* end) {
+    const __m256i control_max = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        // c <= 0x1f (unsigned) <=> min(c, 0x1f) == c
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control_max), chunk);
+        __m256i stop = _mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, tab),
+                                           _mm256_or_si256(control, _mm256_cmpeq_epi8(chunk, del)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(stop));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findDelimiterSse42(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* scanTokenAvx2(const char* p, const char* end) {
+    const __m256i lo_table = _mm256_load_si256(reinterpret_cast<const __m256i*>(TOKEN_TABLES.lo));
+    const __m256i hi_table = _mm256_load_si256(reinterpret_cast<const __m256i*>(TOKEN_TABLES.hi));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i lo_bits = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(chunk, nibble_mask));
+        __m256i hi_bits = _mm256_shuffle_epi8(
+            hi_table, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask));
+        __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(lo_bits, hi_bits), zero);
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(invalid));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return scanTokenSse42(p, end);
+}
+#endif
+
+} // namespace
+
+// Kernels for the parser's hot loops, selected once at startup from CPUID.
+// findDelimiter returns the first byte that is not allowed inside a request
+// or header line (normally the CR ending it); scanToken returns the first
+// byte that is not a tchar (normally the ':' after a header name).
+struct HeaderScanner {
+    enum class Isa { Scalar, Sse42, Avx2 };
+    using ScanFn = const char* (*)(const char* p, const char* end);
+    
+    Isa isa;
+    ScanFn findDelimiter;
+    ScanFn scanToken;
+    
+    static bool supported(Isa isa) {
+        switch (isa) {
+            case Isa::Scalar:
+                return true;
+#if XWEB_X86_SIMD
+            case Isa::Sse42:
+                return __builtin_cpu_supports("sse4.2");
+            case Isa::Avx2:
+                return __builtin_cpu_supports("avx2");
+#endif
+            default:
+                return false;
+        }
+    }
+    
+    static const char* name(Isa isa) {
+        switch (isa) {
+            case Isa::Sse42: return "sse4.2";
+            case Isa::Avx2: return "avx2";
+            default: return "scalar";
+        }
+    }
+    
+    static HeaderScanner forIsa(Isa isa) {
+#if XWEB_X86_SIMD
+        if (isa == Isa::Avx2) {
+            return HeaderScanner{isa, findDelimiterAvx2, scanTokenAvx2};
+        }
+        if (isa == Isa::Sse42) {
+            return HeaderScanner{isa, findDelimiterSse42, scanTokenSse42};
+        }
+#endif
+        return HeaderScanner{Isa::Scalar, findDelimiterScalar, scanTokenScalar};
+    }
+    
+    // Widest kernel set the CPU supports
+    static const HeaderScanner& best() {
+        static const HeaderScanner scanner = forIsa(
+            supported(Isa::Avx2) ? Isa::Avx2 : supported(Isa::Sse42) ? Isa::Sse42 : Isa::Scalar);
+        return scanner;
+    }
+};
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+        if (equalsIgnoreCase(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return std::string_view();
+}
+
+const char* reasonPhrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Content Too Large";
+        case 414: return "URI Too Long";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Error";
+    }
+}
+
+// Incremental HTTP/1.x request parser. parse() is called with the buffer
+// holding the start of the current request each time more bytes arrive; it
+// resumes from the last complete line instead of rescanning, records field
+// positions as offsets (the buffer may be reallocated between calls) and
+// only materializes string_views into the buffer once the request is
+// complete, so nothing is copied. The header list of a complete request is
+// allocated from the caller's arena.
+class HttpParser {
+public:
+    enum class Result { Complete, Incomplete, Error };
+    
+    explicit HttpParser(const ParserLimits& limits,
+                        const HeaderScanner& scanner = HeaderScanner::best())
+        : limits(&limits), scanner(&scanner) {
+        reset();
+    }
+    
+    // Prepares the parser for the next request on the connection
+    void reset() {
+        state = State::RequestLine;
+        pos = 0;
+        scan_pos = 0;
+        request_line_offset = 0;
+        method_length = 0;
+        target_offset = 0;
+        target_length = 0;
+        minor_version = 1;
+        keep_alive = true;
+        has_content_length = false;
+        content_length = 0;
+        head_length = 0;
+        spans.clear();
+        error_status = 0;
+    }
+    
+    // True once the header block is complete and only body bytes are missing
+    bool readingBody() const {
+        return state == State::Body;
+    }
+    
+    // HTTP status to answer with after parse() returned Error
+    int errorStatus() const {
+        return error_status;
+    }
+    
+    Result parse(const char* data, size_t size, HttpRequest& request, Arena& arena) {
+        if (state == State::Failed) {
+            return Result::Error;
+        }
+        
+        const char* end = data + size;
+        while (state != State::Body) {
+            // Everything before the line's CR must be valid line content, so
+            // one scan both finds the end of the line and validates it
+            const char* stop = scanner->findDelimiter(data + scan_pos, end);
+            scan_pos = static_cast<size_t>(stop - data);
+            if (stop != end && *stop != '\r') {
+                return fail(400);
+            }
+            if (stop == end || stop + 1 == end) {
+                if (state == State::RequestLine && scan_pos - pos > limits->max_request_line) {
+                    return fail(414);
+                }
+                if (scan_pos > limits->max_header_bytes) {
+                    return fail(431);
+                }
+                return Result::Incomplete;
+            }
+            if (stop[1] != '\n') {
+                return fail(400);
+            }
+            std::string_view line(data + pos, scan_pos - pos);
+            
+            if (state == State::RequestLine) {
+                if (line.size() > limits->max_request_line) {
+                    return fail(414);
+                }
+                // Empty lines before the request line are ignored (RFC 9112)
+                if (!line.empty()) {
+                    if (!parseRequestLine(line)) {
+                        return fail(error_status != 0 ? error_status : 400);
+                    }
+                    state = State::Headers;
+                }
+            } else if (line.empty()) {
+                head_length = scan_pos + 2;
+                state = State::Body;
+            } else if (!parseHeaderLine(data, line)) {
+                return fail(error_status != 0 ? error_status : 400);
+            }
+            
+            pos = scan_pos + 2;
+            scan_pos = pos;
+            if (pos > limits->max_header_bytes) {
+                return fail(431);
+            }
+        }
+        
+        if (size - head_length < content_length) {
+            return Result::Incomplete;
+        }
+        
+        request.method = std::string_view(data + request_line_offset, method_length);
+        request.target = std::string_view(data + target_offset, target_length);
+        request.minor_version = minor_version;
+        request.keep_alive = keep_alive;
+        request.content_length = content_length;
+        HttpHeader* headers = arena.allocateArray<HttpHeader>(spans.size());
+        for (size_t i = 0; i < spans.size(); ++i) {
+            const HeaderSpan& span = spans[i];
+            new (&headers[i]) HttpHeader{
+                std::string_view(data + span.name_offset, span.name_length),
+                std::string_view(data + span.value_offset, span.value_length)};
+        }
+        request.headers = headers;
+        request.header_count = spans.size();
+        request.body = std::string_view(data + head_length, content_length);
+        request.length = head_length + content_length;
+        return Result::Complete;
+    }
+
+private:
+    enum class State { RequestLine, Headers, Body, Failed };
+    
+    struct HeaderSpan {
+        size_t name_offset;
+        size_t name_length;
+        size_t value_offset;
+        size_t value_length;
+    };
+    
+    const ParserLimits* limits;
+    const HeaderScanner* scanner;
+    State state;
+    // Offset of the first byte not yet consumed as a complete line
+    size_t pos;
+    // Offset up to which the current partial line has been validated
+    size_t scan_pos;
+    size_t request_line_offset;
+    size_t method_length;
+    size_t target_offset;
+    size_t target_length;
+    int minor_version;
+    bool keep_alive;
+    bool has_content_length;
+    size_t content_length;
+    size_t head_length;
+    std::vector<HeaderSpan> spans;
+    int error_status;
+    
+    Result fail(int status) {
+        state = State::Failed;
+        error_status = status;
+        return Result::Error;
+    }
+    
+    bool parseRequestLine(std::string_view line) {
+        const char* line_end = line.data() + line.size();
+        size_t i = static_cast<size_t>(scanner->scanToken(line.data(), line_end) - line.data());
+        if (i == 0 || i >= line.size() || line[i] != ' ') {
+            return false;
+        }
+        method_length = i;
+        request_line_offset = pos;
+        
+        // The line has no CTLs left, so the target runs to the next space;
+        // only a tab could still be hiding in it
+        size_t target_begin = ++i;
+        i = line.find(' ', target_begin);
+        if (i == std::string_view::npos || i == target_begin) {
+            return false;
+        }
+        if (line.substr(target_begin, i - target_begin).find('\t') != std::string_view::npos) {
+            return false;
+        }
+        target_offset = pos + target_begin;
+        target_length = i - target_begin;
+        
+        std::string_view version = line.substr(i + 1);
+        if (version.size() != 8 || version.substr(0, 7) != "HTTP/1.") {
+            if (version.substr(0, 5) == "HTTP/") {
+                error_status = 505;
+            }
+            return false;
+        }
+        if (version[7] == '1') {
+            minor_version = 1;
+        } else if (version[7] == '0') {
+            minor_version = 0;
+        } else {
+            error_status = 505;
+            return false;
+        }
+        
+        // HTTP/1.1 defaults to persistent connections, HTTP/1.0 does not
+        keep_alive = minor_version == 1;
+        return true;
+    }
+    
+    bool parseHeaderLine(const char* data, std::string_view line) {
+        const char* line_end = line.data() + line.size();
+        size_t colon = static_cast<size_t>(scanner->scanToken(line.data(), line_end) - line.data());
+        // Also rejects obsolete line folding, which starts with whitespace
+        if (colon == 0 || colon >= line.size() || line[colon] != ':') {
+            return false;
+        }
+        
+        if (spans.size() >= limits->max_headers) {
+            error_status = 431;
+            return false;
+        }
+        
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = trimWhitespace(line.substr(colon + 1));
+        size_t line_offset = static_cast<size_t>(line.data() - data);
+        spans.push_back(HeaderSpan{line_offset, name.size(),
+                                   static_cast<size_t>(value.data() - data), value.size()});
+        
+        if (equalsIgnoreCase(name, "Connection")) {
+            while (!value.empty()) {
+                size_t comma = value.find(',');
+                std::string_view token = trimWhitespace(value.substr(0, comma));
+                if (equalsIgnoreCase(token, "close")) {
+                    keep_alive = false;
+                } else if (equalsIgnoreCase(token, "keep-alive")) {
+                    keep_alive = true;
+                }
+                value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+            }
+        } else if (equalsIgnoreCase(name, "Content-Length")) {
+            if (value.empty()) {
+                return false;
+            }
+            // Stops growing once past the body limit, or saturates should
+            // the limit be huge, so any number of digits (leading zeros
+            // included) parses without overflowing
+            size_t length = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9') {
+                    return false;
+                }
+                if (length <= limits->max_body) {
+                    length = length > (SIZE_MAX - 9) / 10 ? SIZE_MAX : length * 10 + static_cast<size_t>(c - '0');
+                }
+            }
+            // Conflicting lengths are a request smuggling vector
+            if (has_content_length && length != content_length) {
+                return false;
+            }
+            if (length > limits->max_body) {
+                error_status = 413;
+                return false;
+            }
+            has_content_length = true;
+            content_length = length;
+        } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+            // Chunked request bodies are not supported
+            error_status = 501;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Formatted clock values used in responses. Each thread keeps its own copy
+// and refreshes it lazily on the first call in a new second, so handlers
+// splice in preformatted strings and never call localtime() or take a lock
+// on the request path.
+class ClockService {
+public:
+    struct Snapshot {
+        std::time_t timestamp = -1;
+        // Local time, "YYYY-MM-DD HH:MM:SS"
+        char datetime[32];
+        size_t datetime_length = 0;
+        // Complete "Date: <IMF-fixdate>\r\n" header line (RFC 7231)
+        char date_header[64];
+        size_t date_header_length = 0;
+    };
+    
+    static const Snapshot& now() {
+        thread_local Snapshot snapshot;
+        std::time_t current = std::time(nullptr);
+        if (current != snapshot.timestamp) {
+            refresh(snapshot, current);
+        }
+        return snapshot;
+    }
+    
+    // Writes time as an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT");
+    // returns the length, or 0 if it does not fit
+    static size_t formatHttpDate(std::time_t time, char* out, size_t size) {
+        std::tm utc_tm;
+#ifdef _WIN32
+        gmtime_s(&utc_tm, &time);
+#else
+        gmtime_r(&time, &utc_tm);
+#endif
+        // Formatted by hand: strftime's %a/%b are locale-dependent
+        static const char* const days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+        int length = std::snprintf(out, size, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                                   days[utc_tm.tm_wday], utc_tm.tm_mday, MONTHS[utc_tm.tm_mon],
+                                   utc_tm.tm_year + 1900, utc_tm.tm_hour, utc_tm.tm_min,
+                                   utc_tm.tm_sec);
+        return length > 0 && static_cast<size_t>(length) < size ? static_cast<size_t>(length) : 0;
+    }
+    
+    static std::string formatHttpDate(std::time_t time) {
+        char buffer[64];
+        return std::string(buffer, formatHttpDate(time, buffer, sizeof(buffer)));
+    }
+    
+    // Parses an IMF-fixdate. The obsolete RFC 850 and asctime() forms are
+    // rejected, which makes a conditional request unconditional.
+    static bool parseHttpDate(std::string_view text, std::time_t& time) {
+        // "Sun, 06 Nov 1994 08:49:37 GMT"
+        if (text.size() != 29 || text.substr(3, 2) != ", " || text.substr(25) != " GMT") {
+            return false;
+        }
+        auto number = [&](size_t pos, size_t digits, int& value) {
+            value = 0;
+            for (size_t i = pos; i < pos + digits; ++i) {
+                if (text[i] < '0' || text[i] > '9') {
+                    return false;
+                }
+                value = value * 10 + (text[i] - '0');
+            }
+            return true;
+        };
+        int day, year, hour, minute, second;
+        if (!number(5, 2, day) || !number(12, 4, year) || !number(17, 2, hour) ||
+            !number(20, 2, minute) || !number(23, 2, second) || text[19] != ':' || text[22] != ':') {
+            return false;
+        }
+        int month = 0;
+        while (month < 12 && text.substr(8, 3) != MONTHS[month]) {
+            ++month;
+        }
+        if (month == 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+            return false;
+        }
+        
+        // Days since 1970-01-01 in the proleptic Gregorian calendar; avoids
+        // timegm(), which Windows lacks
+        int y = month < 2 ? year - 1 : year;
+        int era = y / 400;
+        int year_of_era = y - era * 400;
+        int day_of_year = (153 * (month < 2 ? month + 10 : month - 2) + 2) / 5 + day - 1;
+        int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+        long long days = static_cast<long long>(era) * 146097 + day_of_era - 719468;
+        time = static_cast<std::time_t>(days * 86400 + hour * 3600 + minute * 60 + second);
+        return true;
+    }
+
+private:
+    static constexpr const char* MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                             "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    
+    static void refresh(Snapshot& snapshot, std::time_t current) {
+        std::tm local_tm;
+#ifdef _WIN32
+        localtime_s(&local_tm, &current);
+#else
+        localtime_r(&current, &local_tm);
+#endif
+        snapshot.timestamp = current;
+        snapshot.datetime_length = std::strftime(snapshot.datetime, sizeof(snapshot.datetime),
+                                                 "%Y-%m-%d %H:%M:%S", &local_tm);
+        
+        static const char prefix[] = "Date: ";
+        std::memcpy(snapshot.date_header, prefix, sizeof(prefix) - 1);
+        size_t length = sizeof(prefix) - 1;
+        length += formatHttpDate(current, snapshot.date_header + length,
+                                 sizeof(snapshot.date_header) - length - 2);
+        std::memcpy(snapshot.date_header + length, "\r\n", 2);
+        snapshot.date_header_length = length + 2;
+    }
+};
+
+// Bounded multi-producer multi-consumer ring (Vyukov). Every slot carries a
+// sequence number saying whether it is free for the producer at a given
+// position or holds a value for the consumer there, so push and pop are a
+// CAS on the shared index plus one slot access and never take a lock.
+// The capacity is rounded up to a power of two.
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+    
+    // Returns false when the queue is full
+    bool tryPush(const T& value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence - position);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = value;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Returns false when the queue is empty
+    bool tryPop(T& value) {
+        size_t position = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+            if (diff == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = slot.value;
+                    slot.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    // Producers and consumers hammer different indexes; keep them on
+    // separate cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+// Lets threads sleep until a lock-free structure changes state. wait()
+// registers as a sleeper before re-checking its condition, and notify()
+// only takes the mutex when somebody is registered, so the common path
+// is a fence and one atomic load.
+class Parking {
+public:
+    // Blocks until ready() returns true; ready() may consume what it finds
+    template <typename Ready>
+    void wait(Ready ready) {
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers.fetch_add(1);
+        // Pairs with the fence in notify(): either the notifier sees us
+        // registered or we see its update in ready()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready()) {
+            condition.wait(lock);
+        }
+        sleepers.fetch_sub(1);
+    }
+    
+    void notifyOne() {
+        notify(false);
+    }
+    
+    void notifyAll() {
+        notify(true);
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::atomic<unsigned> sleepers{0};
+    
+    void notify(bool all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load() == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (all) {
+            condition.notify_all();
+        } else {
+            condition.notify_one();
+        }
+    }
+};
+
+// Streaming JSON writer over a caller-supplied buffer. It never allocates:
+// when the output does not fit, ok() turns false and the document is cut
+// short. Commas between members and array elements are inserted
+// automatically, for up to 64 levels of nesting.
+class JsonWriter {
+public:
+    JsonWriter(char* buffer, size_t capacity) : buffer(buffer), capacity(capacity) {}
+    
+    JsonWriter& beginObject() {
+        return open('{');
+    }
+    
+    JsonWriter& endObject() {
+        return close('}');
+    }
+    
+    JsonWriter& beginArray() {
+        return open('[');
+    }
+    
+    JsonWriter& endArray() {
+        return close(']');
+    }
+    
+    JsonWriter& key(std::string_view name) {
+        separate();
+        writeString(name);
+        put(':');
+        // The value that follows must not be preceded by a comma
+        after_key = true;
+        return *this;
+    }
+    
+    JsonWriter& string(std::string_view text) {
+        separate();
+        writeString(text);
+        return *this;
+    }
+    
+    template <typename Integer>
+    JsonWriter& number(Integer value) {
+        static_assert(std::is_integral<Integer>::value, "JsonWriter::number takes integers");
+        separate();
+        if (capacity - length < 24) {
+            failed = true;
+            return *this;
+        }
+        auto result = std::to_chars(buffer + length, buffer + capacity, value);
+        length = static_cast<size_t>(result.ptr - buffer);
+        return *this;
+    }
+    
+    JsonWriter& boolean(bool value) {
+        separate();
+        append(value ? std::string_view("true") : std::string_view("false"));
+        return *this;
+    }
+    
+    // Appends pre-serialized JSON as is, without a separator
+    JsonWriter& raw(std::string_view json) {
+        append(json);
+        return *this;
+    }
+    
+    bool ok() const {
+        return !failed;
+    }
+    
+    size_t size() const {
+        return length;
+    }
+    
+    std::string_view view() const {
+        return std::string_view(buffer, length);
+    }
+    
+private:
+    char* buffer;
+    size_t capacity;
+    size_t length = 0;
+    bool failed = false;
+    bool after_key = false;
+    unsigned depth = 0;
+    // Bit n is set once the container at depth n has an element
+    uint64_t has_elements = 0;
+    
+    JsonWriter& open(char bracket) {
+        separate();
+        put(bracket);
+        ++depth;
+        if (depth < 64) {
+            has_elements &= ~(uint64_t(1) << depth);
+        }
+        return *this;
+    }
+    
+    JsonWriter& close(char bracket) {
+        put(bracket);
+        if (depth > 0) {
+            --depth;
+        }
+        return *this;
+    }
+    
+    void separate() {
+        if (after_key) {
+            after_key = false;
+            return;
+        }
+        if (depth > 0 && depth < 64) {
+            if (has_elements & (uint64_t(1) << depth)) {
+                put(',');
+            }
+            has_elements |= uint64_t(1) << depth;
+        }
+    }
+    
+    void put(char c) {
+        if (length < capacity) {
+            buffer[length++] = c;
+        } else {
+            failed = true;
+        }
+    }
+    
+    void append(std::string_view text) {
+        if (capacity - length < text.size()) {
+            failed = true;
+            return;
+        }
+        std::memcpy(buffer + length, text.data(), text.size());
+        length += text.size();
+    }
+    
+    void writeString(std::string_view text) {
+        put('"');
+        // Fast path: copy the run of bytes that need no escaping in one go;
+        // UTF-8 sequences pass through unchanged
+        size_t start = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            append(text.substr(start, i - start));
+            writeEscape(c);
+            start = i + 1;
+        }
+        append(text.substr(start));
+        put('"');
+    }
+    
+    void writeEscape(unsigned char c) {
+        put('\\');
+        switch (c) {
+            case '"': put('"'); break;
+            case '\\': put('\\'); break;
+            case '\b': put('b'); break;
+            case '\f': put('f'); break;
+            case '\n': put('n'); break;
+            case '\r': put('r'); break;
+            case '\t': put('t'); break;
+            default: {
+                static const char hex[] = "0123456789abcdef";
+                char escape[5] = {'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                append(std::string_view(escape, sizeof(escape)));
+                break;
+            }
+        }
+    }
+};
+
+// Pending output of a connection as a list of segments, so a response can
+// be sent with one gather write instead of being concatenated first. Status
+// lines and headers are copied into an owned buffer; large immutable bodies
+// that outlive the connection, such as the prebuilt HTML page, are
+// referenced in place and shared by every connection sending them.
+class OutputBuffer {
+private:
+    struct Segment {
+        // nullptr for bytes stored in owned at offset
+        const char* shared;
+        size_t offset;
+        size_t length;
+    };
+    
+    // Below this size copying is cheaper than an extra iovec
+    static constexpr size_t MIN_SHARED_SIZE = 512;
+    
+    std::string owned;
+    std::vector<Segment> segments;
+    size_t total = 0;
+    size_t sent_bytes = 0;
+    // Segment holding the first unsent byte, and the offset within it
+    size_t cursor = 0;
+    size_t cursor_offset = 0;
+    
+    const char* data(const Segment& segment) const {
+        return segment.shared ? segment.shared : owned.data() + segment.offset;
+    }
+
+public:
+    void append(const char* text, size_t length) {
+        if (length == 0) {
+            return;
+        }
+        // Owned bytes are appended in order, so consecutive copies extend
+        // the same segment
+        if (!segments.empty() && !segments.back().shared) {
+            segments.back().length += length;
+        } else {
+            segments.push_back(Segment{nullptr, owned.size(), length});
+        }
+        owned.append(text, length);
+        total += length;
+    }
+    
+    OutputBuffer& operator+=(std::string_view text) {
+        append(text.data(), text.size());
+        return *this;
+    }
+    
+    // References body without copying it. The bytes must stay unchanged
+    // until the buffer is cleared.
+    void appendShared(std::string_view body) {
+        if (body.size() < MIN_SHARED_SIZE) {
+            append(body.data(), body.size());
+            return;
+        }
+        segments.push_back(Segment{body.data(), 0, body.size()});
+        total += body.size();
+    }
+    
+    // Up to length bytes starting at stream position, if they lie in one
+    // segment. Searches from the end, so recent appends are cheap to reach.
+    std::string_view peek(size_t position, size_t length) const {
+        size_t end = total;
+        for (size_t i = segments.size(); i-- > 0;) {
+            size_t begin = end - segments[i].length;
+            if (position >= begin) {
+                return std::string_view(data(segments[i]) + (position - begin),
+                                        std::min(length, end - position));
+            }
+            end = begin;
+        }
+        return std::string_view();
+    }
+    
+    // Bytes appended since the last clear(), sent or not
+    size_t size() const { return total; }
+    size_t sent() const { return sent_bytes; }
+    bool empty() const { return total == 0; }
+    
+    // Calls visit(data, length) for each unsent piece before position
+    // limit, in order, until it returns false
+    template <typename Visit>
+    void forEachPending(size_t limit, Visit visit) const {
+        size_t position = sent_bytes;
+        size_t offset = cursor_offset;
+        for (size_t i = cursor; i < segments.size() && position < limit; ++i) {
+            size_t length = std::min(segments[i].length - offset, limit - position);
+            if (!visit(data(segments[i]) + offset, length)) {
+                return;
+            }
+            position += length;
+            offset = 0;
+        }
+    }
+    
+#ifndef _WIN32
+    // Fills iov with up to max unsent pieces before position limit for
+    // writev()/sendmsg() and returns how many it filled
+    size_t gather(struct iovec* iov, size_t max, size_t limit) const {
+        size_t count = 0;
+        forEachPending(limit, [&](const char* piece, size_t length) {
+            iov[count].iov_base = const_cast<char*>(piece);
+            iov[count].iov_len = length;
+            return ++count < max;
+        });
+        return count;
+    }
+#endif
+    
+    // Marks count bytes as sent; a partial write may end inside a segment
+    void consume(size_t count) {
+        sent_bytes += count;
+        while (count > 0) {
+            size_t left = segments[cursor].length - cursor_offset;
+            if (count < left) {
+                cursor_offset += count;
+                return;
+            }
+            count -= left;
+            ++cursor;
+            cursor_offset = 0;
+        }
+    }
+    
+    // Keeps capacity so steady-state requests do not allocate
+    void clear() {
+        owned.clear();
+        segments.clear();
+        total = 0;
+        sent_bytes = 0;
+        cursor = 0;
+        cursor_offset = 0;
+    }
+};
+
+enum class ContentCoding { Identity, Gzip, Brotli };
+
+const char* contentCodingName(ContentCoding coding) {
+    switch (coding) {
+        case ContentCoding::Gzip: return "gzip";
+        case ContentCoding::Brotli: return "br";
+        default: return "identity";
+    }
+}
+
+// Parses a q-value ("0", "0.5", "1.000") into thousandths; malformed values
+// count as 0 so a garbled header never selects an encoding
+int parseQuality(std::string_view value) {
+    if (value.empty() || (value[0] != '0' && value[0] != '1')) {
+        return 0;
+    }
+    int quality = (value[0] - '0') * 1000;
+    if (value.size() == 1) {
+        return quality;
+    }
+    if (value[1] != '.' || value.size() > 5) {
+        return 0;
+    }
+    int scale = 100;
+    for (char c : value.substr(2)) {
+        if (c < '0' || c > '9') {
+            return 0;
+        }
+        quality += (c - '0') * scale;
+        scale /= 10;
+    }
+    return std::min(quality, 1000);
+}
+
+// Quality in thousandths that an Accept-Encoding value gives coding: its own
+// entry if listed, else the "*" entry, else -1
+int acceptQuality(std::string_view accept, std::string_view coding) {
+    int wildcard = -1;
+    while (!accept.empty()) {
+        size_t comma = accept.find(',');
+        std::string_view entry = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view() : accept.substr(comma + 1);
+        
+        size_t semicolon = entry.find(';');
+        std::string_view name = trimWhitespace(entry.substr(0, semicolon));
+        int quality = 1000;
+        while (semicolon != std::string_view::npos) {
+            entry = entry.substr(semicolon + 1);
+            semicolon = entry.find(';');
+            std::string_view parameter = trimWhitespace(entry.substr(0, semicolon));
+            if (parameter.size() >= 2 && toLowerAscii(parameter[0]) == 'q' && parameter[1] == '=') {
+                quality = parseQuality(parameter.substr(2));
+            }
+        }
+        if (equalsIgnoreCase(name, coding)) {
+            return quality;
+        }
+        if (name == "*") {
+            wildcard = quality;
+        }
+    }
+    return wildcard;
+}
+
+#ifdef XWEB_GZIP
+// Compresses data into a gzip member at the highest level; only run at
+// startup
+std::string gzipCompress(std::string_view data) {
+    z_stream stream = {};
+    // 15 window bits plus 16 selects the gzip wrapper
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    int status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        throw std::runtime_error("gzip compression failed");
+    }
+    return out;
+}
+#endif
+
+#ifdef XWEB_BROTLI
+// Compresses data with brotli at the highest quality; only run at startup
+std::string brotliCompress(std::string_view data) {
+    size_t size = BrotliEncoderMaxCompressedSize(data.size());
+    std::string out(size, '\0');
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               data.size(), reinterpret_cast<const uint8_t*>(data.data()),
+                               &size, reinterpret_cast<uint8_t*>(&out[0]))) {
+        throw std::runtime_error("brotli compression failed");
+    }
+    out.resize(size);
+    return out;
+}
+#endif
+
+// Weak comparison of etag against an If-None-Match list, "*" matching any
+bool etagMatches(std::string_view list, std::string_view etag) {
+    size_t pos = 0;
+    while (pos < list.size()) {
+        char c = list[pos];
+        if (c == ' ' || c == '\t' || c == ',') {
+            ++pos;
+            continue;
+        }
+        if (c == '*') {
+            return true;
+        }
+        if (list.substr(pos, 2) == "W/") {
+            pos += 2;
+        }
+        if (pos >= list.size() || list[pos] != '"') {
+            return false;
+        }
+        size_t end = list.find('"', pos + 1);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        std::string_view tag = list.substr(pos, end + 1 - pos);
+        if (tag == etag || (etag.substr(0, 2) == "W/" && tag == etag.substr(2))) {
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+// True when a GET or HEAD may be answered with 304: If-None-Match matches,
+// or, only if that header is absent, the representation is no newer than
+// If-Modified-Since (RFC 9110 section 13.2.2)
+bool isNotModified(const HttpRequest& request, std::string_view etag, std::time_t last_modified) {
+    if (request.method != "GET" && request.method != "HEAD") {
+        return false;
+    }
+    std::string_view if_none_match = request.header("If-None-Match");
+    if (!if_none_match.empty()) {
+        return etagMatches(if_none_match, etag);
+    }
+    std::string_view if_modified_since = request.header("If-Modified-Since");
+    std::time_t since;
+    return !if_modified_since.empty() && ClockService::parseHttpDate(if_modified_since, since) &&
+           last_modified <= since;
+}
+
+// Strong entity tag from a 64-bit FNV-1a hash of the body
+std::string createEtag(std::string_view body) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : body) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    char tag[20];
+    std::snprintf(tag, sizeof(tag), "\"%016llx\"", static_cast<unsigned long long>(hash));
+    return tag;
+}
+
+// A constant response body with every content coding it can be sent in,
+// compressed once at startup. Each variant carries its strong ETag and its
+// complete header blocks (after the status line and Date) for 200 and 304
+// in both connection modes, so a request only picks one and never
+// compresses, hashes or formats anything.
+class CachedBody {
+public:
+    struct Variant {
+        ContentCoding coding = ContentCoding::Identity;
+        std::string body;
+        std::string etag;
+        std::string headers_keep_alive;
+        std::string headers_close;
+        std::string not_modified_keep_alive;
+        std::string not_modified_close;
+    };
+    
+    CachedBody() = default;
+    
+    // An empty cache_control omits the header
+    CachedBody(std::string body, std::string_view content_type, std::string_view cache_control,
+               std::time_t last_modified)
+        : last_modified(last_modified) {
+        variants.reserve(3);
+        variants.emplace_back();
+        variants.front().body = std::move(body);
+        // Only keep encodings that actually save bytes
+#ifdef XWEB_BROTLI
+        addVariant(ContentCoding::Brotli, brotliCompress(variants.front().body));
+#endif
+#ifdef XWEB_GZIP
+        addVariant(ContentCoding::Gzip, gzipCompress(variants.front().body));
+#endif
+        std::string validators = "Last-Modified: " + ClockService::formatHttpDate(last_modified) + "\r\n";
+        if (!cache_control.empty()) {
+            validators += "Cache-Control: " + std::string(cache_control) + "\r\n";
+        }
+        for (Variant& variant : variants) {
+            variant.etag = createEtag(variant.body);
+            std::string common = createCommonHeaders(variant, validators);
+            std::string entity = "Content-Type: " + std::string(content_type) + "\r\n";
+            if (variant.coding != ContentCoding::Identity) {
+                entity += std::string("Content-Encoding: ") + contentCodingName(variant.coding) + "\r\n";
+            }
+            std::string length = "Content-Length: " + std::to_string(variant.body.size()) + "\r\n\r\n";
+            variant.headers_keep_alive = entity + common + "Connection: keep-alive\r\n" + length;
+            variant.headers_close = entity + common + "Connection: close\r\n" + length;
+            // A 304 repeats the validators and Vary but carries no body
+            variant.not_modified_keep_alive = common + "Connection: keep-alive\r\n\r\n";
+            variant.not_modified_close = common + "Connection: close\r\n\r\n";
+        }
+    }
+    
+    // Picks the variant for an Accept-Encoding value: the acceptable coding
+    // with the highest q-value, compressed ones winning ties. Identity is
+    // used when nothing else is acceptable, even if the client refused it.
+    const Variant& select(std::string_view accept_encoding) const {
+        const Variant* best = &variants.front();
+        if (variants.size() == 1 || accept_encoding.empty()) {
+            return *best;
+        }
+        int best_quality = std::max(acceptQuality(accept_encoding, "identity"), 0);
+        for (size_t i = 1; i < variants.size(); ++i) {
+            int quality = acceptQuality(accept_encoding, contentCodingName(variants[i].coding));
+            if (quality > 0 && quality >= best_quality &&
+                (best->coding == ContentCoding::Identity || quality > best_quality)) {
+                best = &variants[i];
+                best_quality = quality;
+            }
+        }
+        return *best;
+    }
+    
+    // Whether request's preconditions allow a 304 for variant
+    bool notModified(const HttpRequest& request, const Variant& variant) const {
+        return isNotModified(request, variant.etag, last_modified);
+    }
+    
+private:
+    // Identity first, then compressed variants in order of preference
+    std::vector<Variant> variants;
+    std::time_t last_modified = 0;
+    
+    void addVariant(ContentCoding coding, std::string body) {
+        if (body.size() < variants.front().body.size()) {
+            variants.emplace_back();
+            variants.back().coding = coding;
+            variants.back().body = std::move(body);
+        }
+    }
+    
+    // Headers shared by the 200 and 304 responses of variant
+    std::string createCommonHeaders(const Variant& variant, const std::string& validators) const {
+        // Caches must key every variant, identity included, on the request's
+        // Accept-Encoding
+        std::string headers = variants.size() > 1 ? "Vary: Accept-Encoding\r\n" : "";
+        headers += "ETag: " + variant.etag + "\r\n";
+        headers += validators;
+        return headers;
+    }
+};
+
+// Request methods as bits, so a route can allow several
+enum MethodMask : unsigned {
+    METHOD_GET = 1u << 0,
+    METHOD_HEAD = 1u << 1,
+    METHOD_POST = 1u << 2,
+    METHOD_PUT = 1u << 3,
+    METHOD_DELETE = 1u << 4,
+    METHOD_PATCH = 1u << 5,
+    METHOD_OPTIONS = 1u << 6,
+};
+
+const std::pair<MethodMask, const char*> METHOD_NAMES[] = {
+    {METHOD_GET, "GET"}, {METHOD_HEAD, "HEAD"}, {METHOD_POST, "POST"}, {METHOD_PUT, "PUT"},
+    {METHOD_DELETE, "DELETE"}, {METHOD_PATCH, "PATCH"}, {METHOD_OPTIONS, "OPTIONS"},
+};
+
+// Bit of a request method, 0 for methods no route can allow
+unsigned methodBit(std::string_view method) {
+    for (const auto& entry : METHOD_NAMES) {
+        if (method == entry.second) {
+            return entry.first;
+        }
+    }
+    return 0;
+}
+
+// "Allow: GET, HEAD\r\n" for a method mask, sent with 405 responses
+std::string allowHeader(unsigned methods) {
+    std::string header = "Allow:";
+    for (const auto& entry : METHOD_NAMES) {
+        if (methods & entry.first) {
+            header += header.size() == 6 ? " " : ", ";
+            header += entry.second;
+        }
+    }
+    return header + "\r\n";
+}
+
+class WebServer;
+
+// Routes as counted by Metrics: the static table's entries by index, then
+// the pattern routes, the document root and requests no route took
+constexpr size_t STATIC_ROUTE_COUNT = 3;
+constexpr size_t ROUTE_DYNAMIC = STATIC_ROUTE_COUNT;
+constexpr size_t ROUTE_FILES = STATIC_ROUTE_COUNT + 1;
+constexpr size_t ROUTE_UNMATCHED = STATIC_ROUTE_COUNT + 2;
+constexpr size_t ROUTE_COUNT = STATIC_ROUTE_COUNT + 3;
+
+// Writes the complete response for a request that matched a route
+using RouteHandler = void (WebServer::*)(const HttpRequest&, OutputBuffer&, Arena&) const;
+
+struct StaticRoute {
+    std::string_view path;
+    unsigned methods = 0;
+    RouteHandler handler = nullptr;
+};
+
+// FNV-1a with a seed, usable in constant expressions
+constexpr uint32_t routeHash(std::string_view path, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : path) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+// Exact-path routes compiled into a perfect hash table. The constructor
+// searches for a seed under which no two paths share a slot; when it runs
+// in a constant expression the table is finished at build time and a route
+// list without such a seed (duplicate paths, in practice) fails to compile.
+// A lookup hashes the path once and compares it with at most one route:
+// O(path length), no allocation, independent of the number of routes.
+template <size_t N>
+class StaticRouteTable {
+public:
+    constexpr explicit StaticRouteTable(const StaticRoute (&list)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            routes[i] = list[i];
+        }
+        while (!tryBuild()) {
+            if (++seed == MAX_SEED) {
+                throw std::logic_error("no perfect hash for the route table; duplicate path?");
+            }
+        }
+    }
+    
+    size_t size() const { return N; }
+    const StaticRoute& operator[](size_t index) const { return routes[index]; }
+    size_t indexOf(const StaticRoute* route) const { return static_cast<size_t>(route - routes); }
+    
+    // The route for an exact path, or nullptr
+    const StaticRoute* find(std::string_view path) const {
+        uint8_t slot = slots[routeHash(path, seed) & (SIZE - 1)];
+        if (slot == 0 || routes[slot - 1].path != path) {
+            return nullptr;
+        }
+        return &routes[slot - 1];
+    }
+    
+private:
+    static constexpr uint32_t MAX_SEED = 1u << 16;
+    
+    // At least four slots per route keeps the seed search short
+    static constexpr size_t tableSize() {
+        size_t size = 1;
+        while (size < 4 * N) {
+            size <<= 1;
+        }
+        return size;
+    }
+    static constexpr size_t SIZE = tableSize();
+    static_assert(N < 256, "slots store route indexes in a byte");
+    
+    StaticRoute routes[N] = {};
+    // Route index plus one, 0 for an empty slot
+    uint8_t slots[SIZE] = {};
+    uint32_t seed = 0;
+    
+    constexpr bool tryBuild() {
+        for (size_t i = 0; i < SIZE; ++i) {
+            slots[i] = 0;
+        }
+        for (size_t i = 0; i < N; ++i) {
+            size_t slot = routeHash(routes[i].path, seed) & (SIZE - 1);
+            if (slots[slot] != 0) {
+                return false;
+            }
+            slots[slot] = static_cast<uint8_t>(i + 1);
+        }
+        return true;
+    }
+};
+
+// Parameters captured by a dynamic route, as views into the pattern (names)
+// and the request buffer (values)
+class RouteParams {
+public:
+    static constexpr size_t MAX = 8;
+    
+    // Value of the named parameter, empty if the route has none
+    std::string_view get(std::string_view name) const {
+        for (size_t i = 0; i < count; ++i) {
+            if (items[i].first == name) {
+                return items[i].second;
+            }
+        }
+        return std::string_view();
+    }
+    
+    size_t size() const { return count; }
+    
+private:
+    friend class RadixRouter;
+    
+    std::pair<std::string_view, std::string_view> items[MAX];
+    size_t count = 0;
+};
+
+using RouteFunction =
+    std::function<void(const HttpRequest&, const RouteParams&, OutputBuffer&, Arena&)>;
+
+// Routes registered at startup, matched with a compressed trie. Patterns
+// are literal text plus "{name}" segments, which match one non-empty path
+// segment, and an optional trailing "*name" (or "*"), which matches the rest
+// of the path. Static edges are tried before parameters and parameters
+// before wildcards, backtracking when a branch dead-ends, so the most
+// specific route wins. A lookup walks the path once per branch tried and
+// does not allocate. Not thread-safe for add(): register everything before
+// the server starts.
+class RadixRouter {
+public:
+    struct Endpoint {
+        unsigned methods;
+        RouteFunction handler;
+    };
+    
+    // Throws std::invalid_argument for malformed patterns and for methods
+    // already registered on the same pattern
+    void add(unsigned methods, std::string_view pattern, RouteFunction handler) {
+        if (pattern.empty() || pattern.front() != '/') {
+            throw std::invalid_argument("Route pattern must start with '/': " + std::string(pattern));
+        }
+        Node* node = &root;
+        size_t params = 0;
+        while (!pattern.empty()) {
+            size_t special = pattern.find_first_of("{*");
+            node = insertStatic(node, pattern.substr(0, special));
+            if (special == std::string_view::npos) {
+                break;
+            }
+            pattern.remove_prefix(special);
+            if (++params > RouteParams::MAX) {
+                throw std::invalid_argument("Too many route parameters");
+            }
+            if (pattern.front() == '*') {
+                std::string name(pattern.size() > 1 ? pattern.substr(1) : "*");
+                if (name.find_first_of("/{}") != std::string::npos) {
+                    throw std::invalid_argument("Wildcard must end the route pattern");
+                }
+                node = child(node->wildcard, name);
+                break;
+            }
+            size_t close = pattern.find('}');
+            if (close == std::string_view::npos || close == 1 ||
+                (close + 1 < pattern.size() && pattern[close + 1] != '/')) {
+                throw std::invalid_argument("Malformed route parameter: " + std::string(pattern));
+            }
+            node = child(node->param, std::string(pattern.substr(1, close - 1)));
+            pattern.remove_prefix(close + 1);
+        }
+        
+        for (const Endpoint& endpoint : node->endpoints) {
+            if (endpoint.methods & methods) {
+                throw std::invalid_argument("Route registered twice");
+            }
+        }
+        node->methods |= methods;
+        node->endpoints.push_back(Endpoint{methods, std::move(handler)});
+    }
+    
+    // Matches path and fills params. Returns the endpoint for method, or
+    // nullptr with allowed set to the methods of every pattern that matches
+    // the path (0 when none does).
+    const Endpoint* find(std::string_view path, unsigned method, RouteParams& params,
+                         unsigned& allowed) const {
+        params.count = 0;
+        allowed = 0;
+        const Node* node = match(&root, path, method, params, allowed);
+        if (node == nullptr) {
+            return nullptr;
+        }
+        for (const Endpoint& endpoint : node->endpoints) {
+            if (endpoint.methods & method) {
+                return &endpoint;
+            }
+        }
+        return nullptr;
+    }
+    
+    bool empty() const { return root.children.empty() && !root.param && !root.wildcard; }
+    
+private:
+    struct Node {
+        // Literal text of the edge leading here (static nodes), or the
+        // parameter name (parameter and wildcard nodes)
+        std::string label;
+        // First byte of each static child's label, for a memchr() lookup
+        std::string first_bytes;
+        std::vector<std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> param;
+        std::unique_ptr<Node> wildcard;
+        std::vector<Endpoint> endpoints;
+        // Union of the endpoints' methods
+        unsigned methods = 0;
+    };
+    
+    Node root;
+    
+    // Returns the parameter or wildcard child, creating it if needed
+    static Node* child(std::unique_ptr<Node>& slot, std::string name) {
+        if (!slot) {
+            slot = std::make_unique<Node>();
+            slot->label = std::move(name);
+        } else if (slot->label != name) {
+            throw std::invalid_argument("Conflicting parameter names: " + slot->label + " and " + name);
+        }
+        return slot.get();
+    }
+    
+    // Walks or extends the static edges below node by text, splitting an
+    // edge where text diverges from it
+    static Node* insertStatic(Node* node, std::string_view text) {
+        while (!text.empty()) {
+            size_t index = node->first_bytes.find(text.front());
+            if (index == std::string::npos) {
+                auto leaf = std::make_unique<Node>();
+                leaf->label = std::string(text);
+                node->first_bytes += text.front();
+                node->children.push_back(std::move(leaf));
+                return node->children.back().get();
+            }
+            
+            std::unique_ptr<Node>& next = node->children[index];
+            size_t common = 0;
+            while (common < text.size() && common < next->label.size() &&
+                   text[common] == next->label[common]) {
+                ++common;
+            }
+            if (common < next->label.size()) {
+                auto split = std::make_unique<Node>();
+                split->label = next->label.substr(0, common);
+                next->label.erase(0, common);
+                split->first_bytes = next->label.substr(0, 1);
+                split->children.push_back(std::move(next));
+                next = std::move(split);
+            }
+            node = next.get();
+            text.remove_prefix(common);
+        }
+        return node;
+    }
+    
+    // Depth-first in precedence order. A pattern that matches the path but
+    // not the method only adds to allowed, and the search backtracks: a less
+    // specific pattern may still accept the method.
+    static const Node* match(const Node* node, std::string_view path, unsigned method,
+                             RouteParams& params, unsigned& allowed) {
+        if (path.empty()) {
+            if (node->methods & method) {
+                return node;
+            }
+            allowed |= node->methods;
+        } else {
+            const void* found = std::memchr(node->first_bytes.data(), path.front(),
+                                            node->first_bytes.size());
+            if (found != nullptr) {
+                size_t index = static_cast<size_t>(static_cast<const char*>(found) -
+                                                   node->first_bytes.data());
+                const Node* next = node->children[index].get();
+                if (path.compare(0, next->label.size(), next->label) == 0) {
+                    if (const Node* result =
+                            match(next, path.substr(next->label.size()), method, params, allowed)) {
+                        return result;
+                    }
+                }
+            }
+            if (node->param) {
+                size_t end = std::min(path.find('/'), path.size());
+                if (end > 0) {
+                    size_t mark = params.count;
+                    params.items[params.count++] = {node->param->label, path.substr(0, end)};
+                    if (const Node* result =
+                            match(node->param.get(), path.substr(end), method, params, allowed)) {
+                        return result;
+                    }
+                    params.count = mark;
+                }
+            }
+        }
+        if (node->wildcard) {
+            if (node->wildcard->methods & method) {
+                params.items[params.count++] = {node->wildcard->label, path};
+                return node->wildcard.get();
+            }
+            allowed |= node->wildcard->methods;
+        }
+        return nullptr;
+    }
+};
+
+// Request metrics. Every recording thread owns a shard that only it writes,
+// using relaxed atomic loads and stores without read-modify-write, so a
+// sample costs a few plain instructions and never takes a lock. The shards
+// are summed when /metrics is scraped.
+//
+// Latencies go into log-linear histograms per stage, route and status
+// class: one bucket below 1 us, then two per power of two of nanoseconds up
+// to 2^34 ns (about 17 s), and an overflow bucket.
+class Metrics {
+public:
+    enum Stage { FIRST_BYTE, PARSE, HANDLER, WRITE, STAGE_COUNT };
+    
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    
+    static void record(Stage stage, size_t route, int status, uint64_t nanoseconds) {
+        Shard& shard = local();
+        size_t status_class = statusClass(status);
+        increment(shard.buckets[stage][route][status_class][bucketIndex(nanoseconds)], 1);
+        increment(shard.sums[stage][route][status_class], nanoseconds);
+    }
+    
+    // One wakeup of an event loop's listener that accepted count connections
+    static void countAccepts(size_t count) {
+        Shard& shard = local();
+        size_t bucket = 0;
+        while (bucket + 1 < ACCEPT_BUCKETS && count > acceptBound(bucket)) {
+            ++bucket;
+        }
+        increment(shard.accept_wakeups[bucket], 1);
+        increment(shard.accepts, count);
+    }
+    
+    static void countResponse(size_t route, int status) {
+        if (status >= MIN_STATUS && status <= MAX_STATUS) {
+            increment(local().responses[route][status - MIN_STATUS], 1);
+        }
+    }
+    
+    // Status code of the response that starts at position in out
+    static int statusAt(const OutputBuffer& out, size_t position) {
+        // "HTTP/1.1 200"
+        std::string_view head = out.peek(position, 12);
+        if (head.size() < 12) {
+            return 0;
+        }
+        return (head[9] - '0') * 100 + (head[10] - '0') * 10 + (head[11] - '0');
+    }
+    
+    // Appends every non-empty series in Prometheus text format (0.0.4);
+    // route_names has ROUTE_COUNT entries
+    static void render(std::string& out, const std::string_view* route_names);
+    
+    // Per-connection state for the stages that span several calls: parse
+    // time over the reads of one request, and write time from queuing a
+    // response until the output holding it has drained (for pipelined
+    // batches, the whole batch). First byte runs from accept to the first
+    // successful send.
+    class Tracker {
+    public:
+        explicit Tracker(uint64_t accepted_at = now()) : accepted_at(accepted_at) {}
+        
+        void parsed(uint64_t start, uint64_t end) { parse_time += end - start; }
+        
+        // A response was queued; its handler started at handler_start
+        void responded(size_t route, int status, uint64_t handler_start) {
+            if (status == 0) {
+                // Nothing was queued
+                return;
+            }
+            uint64_t time = now();
+            record(PARSE, route, status, parse_time);
+            record(HANDLER, route, status, time - handler_start);
+            countResponse(route, status);
+            parse_time = 0;
+            pending.push_back(Pending{route, status, time});
+        }
+        
+        // Some output reached the socket
+        void wrote() {
+            if (accepted_at != 0 && !pending.empty()) {
+                record(FIRST_BYTE, pending.front().route, pending.front().status, now() - accepted_at);
+                accepted_at = 0;
+            }
+        }
+        
+        // All queued output reached the socket
+        void drained() {
+            if (pending.empty()) {
+                return;
+            }
+            uint64_t time = now();
+            for (const Pending& response : pending) {
+                record(WRITE, response.route, response.status, time - response.queued_at);
+            }
+            pending.clear();
+        }
+        
+    private:
+        struct Pending {
+            size_t route;
+            int status;
+            uint64_t queued_at;
+        };
+        
+        uint64_t accepted_at;
+        uint64_t parse_time = 0;
+        std::vector<Pending> pending;
+    };
+    
+private:
+    static constexpr size_t STATUS_CLASSES = 5;
+    static constexpr int MIN_STATUS = 100;
+    static constexpr int MAX_STATUS = 599;
+    static constexpr unsigned MIN_OCTAVE = 10;
+    static constexpr unsigned MAX_OCTAVE = 34;
+    // The last bucket holds everything from 2^MAX_OCTAVE ns up
+    static constexpr size_t BUCKETS = 2 + 2 * (MAX_OCTAVE - MIN_OCTAVE);
+    // Accepts per wakeup: 0, 1, 2, 4, ... 64, more
+    static constexpr size_t ACCEPT_BUCKETS = 9;
+    
+    struct Shard {
+        std::atomic<uint64_t> buckets[STAGE_COUNT][ROUTE_COUNT][STATUS_CLASSES][BUCKETS];
+        std::atomic<uint64_t> sums[STAGE_COUNT][ROUTE_COUNT][STATUS_CLASSES];
+        std::atomic<uint64_t> responses[ROUTE_COUNT][MAX_STATUS - MIN_STATUS + 1];
+        std::atomic<uint64_t> accept_wakeups[ACCEPT_BUCKETS];
+        std::atomic<uint64_t> accepts;
+    };
+    
+    // Only the owning thread writes, so a load and a store suffice and no
+    // locked instruction is needed
+    static void increment(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    
+    static size_t statusClass(int status) {
+        return static_cast<size_t>(std::min(std::max(status / 100, 1), 5) - 1);
+    }
+    
+    static size_t bucketIndex(uint64_t nanoseconds) {
+        if (nanoseconds < (uint64_t(1) << MIN_OCTAVE)) {
+            return 0;
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        unsigned octave = 63 - static_cast<unsigned>(__builtin_clzll(nanoseconds));
+#else
+        unsigned octave = 0;
+        while (nanoseconds >> (octave + 1)) {
+            ++octave;
+        }
+#endif
+        size_t index = 1 + 2 * (octave - MIN_OCTAVE) + ((nanoseconds >> (octave - 1)) & 1);
+        return std::min(index, BUCKETS - 1);
+    }
+    
+    static uint64_t acceptBound(size_t index) {
+        return index == 0 ? 0 : uint64_t(1) << (index - 1);
+    }
+    
+    // Upper bound of a finite bucket, in nanoseconds
+    static uint64_t bucketBound(size_t index) {
+        if (index == 0) {
+            return uint64_t(1) << MIN_OCTAVE;
+        }
+        unsigned octave = MIN_OCTAVE + static_cast<unsigned>((index - 1) / 2);
+        return (uint64_t(1) << octave) + ((index - 1) % 2 + 1) * (uint64_t(1) << (octave - 1));
+    }
+    
+    // Shards live until exit so the counts of finished threads are kept
+    static std::mutex& registryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+    
+    static std::vector<std::unique_ptr<Shard>>& registry() {
+        static std::vector<std::unique_ptr<Shard>> shards;
+        return shards;
+    }
+    
+    static Shard& local() {
+        thread_local Shard* shard = nullptr;
+        if (shard == nullptr) {
+            // Once per thread; value-initialization zeroes the counters
+            auto created = std::make_unique<Shard>();
+            shard = created.get();
+            std::lock_guard<std::mutex> lock(registryMutex());
+            registry().push_back(std::move(created));
+        }
+        return *shard;
+    }
+};
+
+void Metrics::render(std::string& out, const std::string_view* route_names) {
+    static const char* const stage_names[] = {"first_byte", "parse", "handler", "write"};
+    static const char* const class_names[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+    
+    // Merge the shards; other threads keep recording meanwhile, so a
+    // scrape may miss the samples of the last few nanoseconds
+    auto merged = std::make_unique<Shard>();
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for (const auto& shard : registry()) {
+            auto add = [](std::atomic<uint64_t>& total, const std::atomic<uint64_t>& value) {
+                total.store(total.load(std::memory_order_relaxed) + value.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+            };
+            for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+                for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+                    for (size_t status = 0; status < STATUS_CLASSES; ++status) {
+                        for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+                            add(merged->buckets[stage][route][status][bucket],
+                                shard->buckets[stage][route][status][bucket]);
+                        }
+                        add(merged->sums[stage][route][status], shard->sums[stage][route][status]);
+                    }
+                }
+            }
+            for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+                for (int status = MIN_STATUS; status <= MAX_STATUS; ++status) {
+                    add(merged->responses[route][status - MIN_STATUS],
+                        shard->responses[route][status - MIN_STATUS]);
+                }
+            }
+            for (size_t bucket = 0; bucket < ACCEPT_BUCKETS; ++bucket) {
+                add(merged->accept_wakeups[bucket], shard->accept_wakeups[bucket]);
+            }
+            add(merged->accepts, shard->accepts);
+        }
+    }
+    
+    char number[32];
+    out += "# HELP xweb_responses_total Responses sent, by route and status code.\n"
+           "# TYPE xweb_responses_total counter\n";
+    for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+        for (int status = MIN_STATUS; status <= MAX_STATUS; ++status) {
+            uint64_t count = merged->responses[route][status - MIN_STATUS].load(std::memory_order_relaxed);
+            if (count == 0) {
+                continue;
+            }
+            out += "xweb_responses_total{route=\"";
+            out += route_names[route];
+            out += "\",status=\"";
+            appendDecimal(out, status);
+            out += "\"} ";
+            appendDecimal(out, count);
+            out += '\n';
+        }
+    }
+    
+    out += "# HELP xweb_request_duration_seconds Time spent in each request stage.\n"
+           "# TYPE xweb_request_duration_seconds histogram\n";
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+            for (size_t status = 0; status < STATUS_CLASSES; ++status) {
+                const std::atomic<uint64_t>* buckets = merged->buckets[stage][route][status];
+                uint64_t count = 0;
+                for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+                    count += buckets[bucket].load(std::memory_order_relaxed);
+                }
+                if (count == 0) {
+                    continue;
+                }
+                std::string labels = std::string("stage=\"") + stage_names[stage] + "\",route=\"" +
+                                     std::string(route_names[route]) + "\",status=\"" +
+                                     class_names[status] + "\"";
+                uint64_t cumulative = 0;
+                for (size_t bucket = 0; bucket + 1 < BUCKETS; ++bucket) {
+                    cumulative += buckets[bucket].load(std::memory_order_relaxed);
+                    std::snprintf(number, sizeof(number), "%.9g", bucketBound(bucket) / 1e9);
+                    out += "xweb_request_duration_seconds_bucket{" + labels + ",le=\"" + number + "\"} ";
+                    appendDecimal(out, cumulative);
+                    out += '\n';
+                }
+                out += "xweb_request_duration_seconds_bucket{" + labels + ",le=\"+Inf\"} ";
+                appendDecimal(out, count);
+                std::snprintf(number, sizeof(number), "%.9g",
+                              merged->sums[stage][route][status].load(std::memory_order_relaxed) / 1e9);
+                out += "\nxweb_request_duration_seconds_sum{" + labels + "} " + number;
+                out += "\nxweb_request_duration_seconds_count{" + labels + "} ";
+                appendDecimal(out, count);
+                out += '\n';
+            }
+        }
+    }
+    
+    uint64_t wakeups = 0;
+    for (size_t bucket = 0; bucket < ACCEPT_BUCKETS; ++bucket) {
+        wakeups += merged->accept_wakeups[bucket].load(std::memory_order_relaxed);
+    }
+    if (wakeups == 0) {
+        return;
+    }
+    out += "# HELP xweb_accepts_per_wakeup Connections accepted each time an event loop's listener was ready.\n"
+           "# TYPE xweb_accepts_per_wakeup histogram\n";
+    uint64_t cumulative = 0;
+    for (size_t bucket = 0; bucket + 1 < ACCEPT_BUCKETS; ++bucket) {
+        cumulative += merged->accept_wakeups[bucket].load(std::memory_order_relaxed);
+        out += "xweb_accepts_per_wakeup_bucket{le=\"";
+        appendDecimal(out, acceptBound(bucket));
+        out += "\"} ";
+        appendDecimal(out, cumulative);
+        out += '\n';
+    }
+    out += "xweb_accepts_per_wakeup_bucket{le=\"+Inf\"} ";
+    appendDecimal(out, wakeups);
+    out += "\nxweb_accepts_per_wakeup_sum ";
+    appendDecimal(out, merged->accepts.load(std::memory_order_relaxed));
+    out += "\nxweb_accepts_per_wakeup_count ";
+    appendDecimal(out, wakeups);
+    out += '\n';
+}
+
+// Access log written by a background thread. Request threads copy a
+// fixed-size binary record into a ring of their own (single producer,
+// single consumer, no lock), so logging costs a memcpy and two atomic
+// stores on the request path. When a ring is full the record is dropped and
+// counted. The writer thread drains every ring, formats the records and
+// writes them in batches of up to BATCH_SIZE bytes with one write call each.
+class AccessLog {
+public:
+    struct Record {
+        std::time_t time;
+        uint64_t bytes;
+        // IPv4 address in network byte order
+        uint32_t client;
+        uint16_t status;
+        uint8_t minor_version;
+        // Fields longer than their buffers are truncated
+        uint8_t method_length;
+        uint8_t target_length;
+        uint8_t referer_length;
+        uint8_t user_agent_length;
+        char method[16];
+        char target[255];
+        char referer[128];
+        char user_agent[160];
+    };
+    
+    explicit AccessLog(const ServerConfig& config)
+        : path(config.access_log_path),
+          format(config.access_log_format),
+          ring_capacity(config.access_log_buffer),
+          rotate_size(config.access_log_rotate_size) {
+        open();
+        writer = std::thread([this]() { run(); });
+    }
+    
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+    
+    ~AccessLog() {
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+        if (file != nullptr) {
+            std::fclose(file);
+        }
+    }
+    
+    // Body length of the response that starts at position in out, which is
+    // what the log's byte count reports (%b). The header block is copied,
+    // so it lies in one segment; the body may be shared after it.
+    static uint64_t bodyBytes(const OutputBuffer& out, size_t position) {
+        std::string_view head = out.peek(position, out.size() - position);
+        size_t end = head.find("\r\n\r\n");
+        if (end == std::string_view::npos) {
+            return 0;
+        }
+        return out.size() - (position + end + 4);
+    }
+    
+    // Queues one entry; request is nullptr for requests that failed to
+    // parse. Never blocks.
+    void log(const HttpRequest* request, uint32_t client, int status, uint64_t bytes) {
+        Ring& ring = local();
+        Record* record = ring.claim();
+        if (record == nullptr) {
+            ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+            return;
+        }
+        record->time = ClockService::now().timestamp;
+        record->bytes = bytes;
+        record->client = client;
+        record->status = static_cast<uint16_t>(status);
+        record->minor_version = static_cast<uint8_t>(request ? request->minor_version : 1);
+        record->method_length = copy(record->method, request ? request->method : "");
+        record->target_length = copy(record->target, request ? request->target : "");
+        record->referer_length = copy(record->referer, request ? request->header("Referer") : "");
+        record->user_agent_length =
+            copy(record->user_agent, request ? request->header("User-Agent") : "");
+        ring.commit();
+    }
+    
+    // Records dropped because a ring was full, over all threads
+    uint64_t dropped() const {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        uint64_t total = 0;
+        for (const auto& ring : rings) {
+            total += ring->dropped.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+    
+private:
+    static constexpr size_t BATCH_SIZE = 256 * 1024;
+    
+    // Single-producer single-consumer ring of records. The capacity is
+    // rounded up to a power of two.
+    struct Ring {
+        explicit Ring(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            slots.reset(new Record[size]);
+            mask = size - 1;
+        }
+        
+        // The slot for the next record, or nullptr if the ring is full
+        Record* claim() {
+            size_t position = tail.load(std::memory_order_relaxed);
+            if (position - head.load(std::memory_order_acquire) > mask) {
+                return nullptr;
+            }
+            return &slots[position & mask];
+        }
+        
+        void commit() {
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+        
+        // Calls visit for every committed record and frees their slots
+        template <typename Visit>
+        size_t drain(Visit visit) {
+            size_t position = head.load(std::memory_order_relaxed);
+            size_t end = tail.load(std::memory_order_acquire);
+            for (size_t i = position; i != end; ++i) {
+                visit(slots[i & mask]);
+            }
+            head.store(end, std::memory_order_release);
+            return end - position;
+        }
+        
+        std::unique_ptr<Record[]> slots;
+        size_t mask;
+        // Written by the writer thread
+        alignas(64) std::atomic<size_t> head{0};
+        // Written by the owning request thread, as is dropped
+        alignas(64) std::atomic<size_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+    
+    std::string path;
+    ServerConfig::LogFormat format;
+    size_t ring_capacity;
+    uint64_t rotate_size;
+    std::FILE* file = nullptr;
+    uint64_t file_size = 0;
+    
+    mutable std::mutex rings_mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    // Identifies this log to the threads' cached rings; unlike the address
+    // it is never reused by a later log
+    uint64_t generation = nextGeneration();
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+    
+    // Formatted timestamp of the last second seen by the writer
+    std::time_t formatted_time = -1;
+    char time_text[40];
+    size_t time_length = 0;
+    
+    template <size_t Size>
+    static uint8_t copy(char (&field)[Size], std::string_view value) {
+        static_assert(Size <= 255, "lengths are stored in a byte");
+        size_t length = std::min(value.size(), Size);
+        std::memcpy(field, value.data(), length);
+        return static_cast<uint8_t>(length);
+    }
+    
+    static uint64_t nextGeneration() {
+        static std::atomic<uint64_t> counter{0};
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    
+    // The calling thread's ring, registered on first use
+    Ring& local() {
+        thread_local uint64_t owner = 0;
+        thread_local Ring* ring = nullptr;
+        if (owner != generation) {
+            auto created = std::make_unique<Ring>(ring_capacity);
+            ring = created.get();
+            owner = generation;
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            rings.push_back(std::move(created));
+        }
+        return *ring;
+    }
+    
+    void open() {
+#ifdef __linux__
+        // Close-on-exec ("e"): only the listeners may reach the process
+        // started by a binary upgrade
+        file = std::fopen(path.c_str(), "abe");
+#else
+        file = std::fopen(path.c_str(), "ab");
+#endif
+        if (file == nullptr) {
+            throw std::runtime_error("Cannot open access log " + path + ": " + std::strerror(errno));
+        }
+        // Batches are already large; write each with a single call
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        file_size = size > 0 ? static_cast<uint64_t>(size) : 0;
+    }
+    
+    // Moves the full file to <path>.1, replacing the previous one
+    void rotate() {
+        std::fclose(file);
+        file = nullptr;
+        std::string rotated = path + ".1";
+        std::remove(rotated.c_str());
+        if (std::rename(path.c_str(), rotated.c_str()) != 0) {
+            std::cerr << "Access log rotation failed: " << std::strerror(errno) << std::endl;
+        }
+        open();
+    }
+    
+    void flush(std::string& batch) {
+        if (batch.empty()) {
+            return;
+        }
+        if (rotate_size != 0 && file_size + batch.size() > rotate_size && file_size > 0) {
+            rotate();
+        }
+        if (std::fwrite(batch.data(), 1, batch.size(), file) != batch.size()) {
+            std::cerr << "Access log write failed: " << std::strerror(errno) << std::endl;
+        }
+        file_size += batch.size();
+        batch.clear();
+    }
+    
+    void run() {
+        std::string batch;
+        batch.reserve(BATCH_SIZE + 4096);
+        std::vector<Ring*> snapshot;
+        while (true) {
+            // Read the flag first: records committed before it was set are
+            // still drained below
+            bool last = stopping.load(std::memory_order_acquire);
+            {
+                std::lock_guard<std::mutex> lock(rings_mutex);
+                snapshot.clear();
+                for (const auto& ring : rings) {
+                    snapshot.push_back(ring.get());
+                }
+            }
+            size_t drained = 0;
+            for (Ring* ring : snapshot) {
+                drained += ring->drain([&](const Record& record) {
+                    append(batch, record);
+                    if (batch.size() >= BATCH_SIZE) {
+                        flush(batch);
+                    }
+                });
+            }
+            flush(batch);
+            if (last) {
+                return;
+            }
+            // Polling keeps request threads from ever signalling. Sleeping
+            // after busy passes too lets records accumulate into large
+            // batches instead of competing with the request threads for CPU
+            // one record at a time.
+            std::this_thread::sleep_for(std::chrono::milliseconds(drained == 0 ? 10 : 1));
+        }
+    }
+    
+    // Escapes a field for the log formats: quotes, backslashes and control
+    // bytes become \xHH as in Apache's logs, so a client cannot forge
+    // entries or break the quoting
+    static void appendEscaped(std::string& out, const char* text, size_t length) {
+        static const char hex[] = "0123456789abcdef";
+        size_t run = 0;
+        for (size_t i = 0; i < length; ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c < 0x20 || c == '"' || c == '\\' || c == 0x7f) {
+                out.append(text + run, i - run);
+                char escape[4] = {'\\', 'x', hex[c >> 4], hex[c & 0xf]};
+                out.append(escape, sizeof(escape));
+                run = i + 1;
+            }
+        }
+        out.append(text + run, length - run);
+    }
+    
+    // A quoted field, or "-" when the request did not send it
+    static void appendQuoted(std::string& out, const char* text, size_t length) {
+        if (length == 0) {
+            out += "\"-\"";
+            return;
+        }
+        out += '"';
+        appendEscaped(out, text, length);
+        out += '"';
+    }
+    
+    static void appendClient(std::string& out, uint32_t client) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&client);
+        for (int i = 0; i < 4; ++i) {
+            if (i > 0) {
+                out += '.';
+            }
+            appendDecimal(out, bytes[i]);
+        }
+    }
+    
+    // Caches the formatted time per second: "10/Oct/2000:13:55:36 +0000"
+    // for the text formats, "2000-10-10T13:55:36Z" for JSON
+    void formatTime(std::time_t time) {
+        if (time == formatted_time) {
+            return;
+        }
+        std::tm utc_tm;
+#ifdef _WIN32
+        gmtime_s(&utc_tm, &time);
+#else
+        gmtime_r(&time, &utc_tm);
+#endif
+        static const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                             "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+        int length = format == ServerConfig::LogFormat::Json
+            ? std::snprintf(time_text, sizeof(time_text), "%04d-%02d-%02dT%02d:%02d:%02dZ",
+                            utc_tm.tm_year + 1900, utc_tm.tm_mon + 1, utc_tm.tm_mday,
+                            utc_tm.tm_hour, utc_tm.tm_min, utc_tm.tm_sec)
+            : std::snprintf(time_text, sizeof(time_text), "%02d/%s/%04d:%02d:%02d:%02d +0000",
+                            utc_tm.tm_mday, months[utc_tm.tm_mon], utc_tm.tm_year + 1900,
+                            utc_tm.tm_hour, utc_tm.tm_min, utc_tm.tm_sec);
+        time_length = length > 0 ? static_cast<size_t>(length) : 0;
+        formatted_time = time;
+    }
+    
+    void append(std::string& out, const Record& record) {
+        formatTime(record.time);
+        if (format == ServerConfig::LogFormat::Json) {
+            appendJson(out, record);
+            return;
+        }
+        
+        // Common: host ident user [time] "request" status bytes
+        appendClient(out, record.client);
+        out += " - - [";
+        out.append(time_text, time_length);
+        out += "] \"";
+        if (record.method_length == 0) {
+            out += '-';
+        } else {
+            appendEscaped(out, record.method, record.method_length);
+            out += ' ';
+            appendEscaped(out, record.target, record.target_length);
+            out += record.minor_version == 0 ? " HTTP/1.0" : " HTTP/1.1";
+        }
+        out += "\" ";
+        appendDecimal(out, record.status);
+        out += ' ';
+        if (record.bytes == 0) {
+            out += '-';
+        } else {
+            appendDecimal(out, record.bytes);
+        }
+        if (format == ServerConfig::LogFormat::Combined) {
+            out += ' ';
+            appendQuoted(out, record.referer, record.referer_length);
+            out += ' ';
+            appendQuoted(out, record.user_agent, record.user_agent_length);
+        }
+        out += '\n';
+    }
+    
+    void appendJson(std::string& out, const Record& record) {
+        std::string client;
+        appendClient(client, record.client);
+        
+        // Fits every field escaped as \u00XX, the worst case
+        char buffer[4096];
+        JsonWriter json(buffer, sizeof(buffer));
+        json.beginObject()
+            .key("time").string(std::string_view(time_text, time_length))
+            .key("client").string(client)
+            .key("method").string(std::string_view(record.method, record.method_length))
+            .key("target").string(std::string_view(record.target, record.target_length))
+            .key("protocol").string(record.minor_version == 0 ? "HTTP/1.0" : "HTTP/1.1")
+            .key("status").number(record.status)
+            .key("bytes").number(static_cast<long long>(record.bytes))
+            .key("referer").string(std::string_view(record.referer, record.referer_length))
+            .key("user_agent").string(std::string_view(record.user_agent, record.user_agent_length))
+            .endObject();
+        out.append(json.view());
+        out += '\n';
+    }
+};
+
+namespace bench {
+int runAllocations();
+int routeRaw(const WebServer& server, std::string_view raw, OutputBuffer& out);
+}
+
+class WebServer {
+private:
+    ServerConfig config;
+    int server_fd;
+    std::vector<int> listen_fds;
+    struct sockaddr_in server_addr;
+    
+    // The HTML page never changes, so its encodings and headers are built
+    // once and shared read-only by all workers. Bodies are sent from here
+    // rather than copied per response.
+    CachedBody html;
+    
+    // The /api body with its constant members serialized once; requests
+    // only write datetime and timestamp between the pieces
+    struct ApiBodyTemplate {
+        std::string prefix;
+        std::string middle;
+        std::string suffix;
+        // Buffer size that fits the body with any datetime value
+        size_t max_size = 0;
+    };
+    ApiBodyTemplate api_template;
+    std::string api_cache_control_header;
+    // Pattern routes added at startup with addRoute()
+    RadixRouter router;
+    // Null when no access log is configured
+    std::unique_ptr<AccessLog> access_log;
+    // CPU of each event loop, from cpu_affinity; empty when not pinned
+    std::vector<int> worker_cpus;
+    // Readable once a new process has taken over the listeners; the loops
+    // then stop accepting and finish their connections (Linux)
+    int drain_fd = -1;
+    
+#ifdef _WIN32
+    WSADATA wsa_data;
+#endif
+
+    std::string createHtmlPage() const {
+        std::ostringstream html;
+        html << "<!DOCTYPE html>"
+             << "<html lang=\"en\">"
+             << "<head>"
+             << "<meta charset=\"UTF-8\">"
+             << "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">"
+             << "<title>C++ Web Server</title>"
+             << "<style>"
+             << "body {"
+             << "font-family: 'Segoe UI', Tahoma, Geneva, Verdana, sans-serif;"
+             << "margin: 0; padding: 40px;"
+             << "background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);"
+             << "min-height: 100vh; color: #333;"
+             << "}"
+             << ".container {"
+             << "max-width: 900px; margin: 0 auto; background-color: white;"
+             << "padding: 40px; border-radius: 15px;"
+             << "box-shadow: 0 10px 30px rgba(0,0,0,0.2);"
+             << "}"
+             << "h1 {"
+             << "color: #2c3e50; text-align: center; margin-bottom: 10px;"
+             << "font-size: 2.5em; font-weight: 300;"
+             << "}"
+             << ".language-badge {"
+             << "display: inline-block;"
+             << "background: linear-gradient(45deg, #00599c, #004482);"
+             << "color: white; padding: 8px 16px; border-radius: 25px;"
+             << "font-size: 0.9em; font-weight: bold; margin-left: 10px;"
+             << "box-shadow: 0 2px 10px rgba(0,0,0,0.2);"
+             << "}"
+             << "h2 {"
+             << "color: #34495e; border-bottom: 3px solid #3498db;"
+             << "padding-bottom: 10px; margin-top: 40px;"
+             << "}"
+             << ".info-grid {"
+             << "display: grid; grid-template-columns: auto 1fr;"
+             << "gap: 15px 25px; margin: 25px 0;"
+             << "background: linear-gradient(135deg, #f8f9fa, #e9ecef);"
+             << "padding: 25px; border-radius: 10px;"
+             << "border-left: 5px solid #3498db;"
+             << "}"
+             << ".info-label { font-weight: bold; color: #2c3e50; }"
+             << ".info-value { color: #34495e; }"
+             << "a {"
+             << "color: #3498db; text-decoration: none; font-weight: 500;"
+             << "transition: all 0.3s ease;"
+             << "}"
+             << "a:hover { color: #2980b9; text-decoration: underline; }"
+             << "#browser {"
+             << "background: linear-gradient(135deg, #e8f4f8, #d1ecf1);"
+             << "padding: 20px; border-radius: 10px; margin-top: 15px;"
+             << "border-left: 5px solid #17a2b8;"
+             << "font-family: 'Courier New', monospace; font-size: 0.9em;"
+             << "}"
+             << ".footer {"
+             << "text-align: center; margin-top: 40px; padding-top: 20px;"
+             << "border-top: 1px solid #dee2e6; color: #6c757d; font-size: 0.9em;"
+             << "}"
+             << "</style>"
+             << "</head>"
+             << "<body>"
+             << "<div class=\"container\">"
+             << "<h1>Hello, World! <span class=\"language-badge\">C++</span></h1>"
+             << "<h2>Server Information</h2>"
+             << "<div class=\"info-grid\">"
+             << "<span class=\"info-label\">Port:</span>"
+             << "<span class=\"info-value\">" << PORT << "</span>"
+             << "<span class=\"info-label\">Platform:</span>"
+#ifdef _WIN32
+             << "<span class=\"info-value\">Windows</span>"
+#else
+             << "<span class=\"info-value\">Linux/Unix</span>"
+#endif
+             << "<span class=\"info-label\">API Endpoint:</span>"
+             << "<span class=\"info-value\"><a href='/api'>/api</a></span>"
+             << "</div>"
+             << "<h2>Browser Information</h2>"
+             << "<div id='browser'><em>JavaScript required to display browser information</em></div>"
+             << "<div class=\"footer\">"
+             << "<p>Multi-Language Web Server Collection | C++ Implementation</p>"
+             << "</div>"
+             << "</div>"
+             << "<script>"
+             << "const browserInfo = document.getElementById('browser');"
+             << "const info = ["
+             << "'<strong>User-Agent:</strong> ' + navigator.userAgent,"
+             << "'<strong>Platform:</strong> ' + navigator.platform,"
+             << "'<strong>Language:</strong> ' + navigator.language,"
+             << "'<strong>Languages:</strong> ' + navigator.languages.join(', '),"
+             << "'<strong>Cookies enabled:</strong> ' + navigator.cookieEnabled,"
+             << "'<strong>Screen resolution:</strong> ' + screen.width + 'x' + screen.height,"
+             << "'<strong>Color depth:</strong> ' + screen.colorDepth + ' bits',"
+             << "'<strong>Timezone:</strong> ' + Intl.DateTimeFormat().resolvedOptions().timeZone,"
+             << "'<strong>Online status:</strong> ' + (navigator.onLine ? 'Online' : 'Offline'),"
+             << "'<strong>Hardware concurrency:</strong> ' + (navigator.hardwareConcurrency || 'Unknown') + ' cores'"
+             << "];"
+             << "browserInfo.innerHTML = info.join('<br>');"
+             << "</script>"
+             << "</body></html>";
+        
+        return html.str();
+    }
+    
+    // Serializes the /api body with empty placeholders for the two
+    // per-request values and keeps the text around them
+    static ApiBodyTemplate createApiTemplate() {
+        char buffer[512];
+        JsonWriter json(buffer, sizeof(buffer));
+        json.beginObject()
+            .key("server_info").beginObject()
+            .key("port").number(PORT)
+#ifdef _WIN32
+            .key("platform").string("win32")
+            .key("os").string("Windows")
+#else
+            .key("platform").string("unix")
+            .key("os").string("Linux/Unix")
+#endif
+            .key("datetime");
+        size_t datetime_begin = json.size();
+        json.string("");
+        size_t datetime_end = json.size();
+        json.key("timestamp");
+        size_t timestamp_begin = json.size();
+        json.number(0);
+        size_t timestamp_end = json.size();
+        json.key("status").string("running")
+            .key("language").string("cpp")
+            .endObject()
+            .key("message").string("Server API endpoint")
+            .endObject();
+        if (!json.ok()) {
+            throw std::logic_error("API template does not fit its buffer");
+        }
+        
+        std::string_view text = json.view();
+        ApiBodyTemplate api;
+        api.prefix = std::string(text.substr(0, datetime_begin));
+        api.middle = std::string(text.substr(datetime_end, timestamp_begin - datetime_end));
+        api.suffix = std::string(text.substr(timestamp_end));
+        // Every datetime byte escaped as \uXXXX, plus quotes and a 64-bit
+        // timestamp
+        api.max_size = api.prefix.size() + api.middle.size() + api.suffix.size() +
+                       6 * sizeof(ClockService::Snapshot::datetime) + 2 + 24;
+        return api;
+    }
+    
+    // Routes matched by exact path, hashed when the program is compiled
+    static const StaticRouteTable<STATIC_ROUTE_COUNT> routes;
+    
+    // Appends the /api response to out. The body is written into a buffer
+    // from the request's arena because Content-Length must precede it.
+    void serveApi(const HttpRequest& request, OutputBuffer& out, Arena& arena) const {
+        const ClockService::Snapshot& clock = ClockService::now();
+        char* buffer = arena.allocateArray<char>(api_template.max_size);
+        JsonWriter json(buffer, api_template.max_size);
+        json.raw(api_template.prefix)
+            .string(std::string_view(clock.datetime, clock.datetime_length))
+            .raw(api_template.middle)
+            .number(static_cast<long long>(clock.timestamp))
+            .raw(api_template.suffix);
+        
+        out += "HTTP/1.1 200 OK\r\n";
+        out.append(clock.date_header, clock.date_header_length);
+        out += api_cache_control_header;
+        out += request.keep_alive
+                   ? "Content-Type: application/json\r\nConnection: keep-alive\r\nContent-Length: "
+                   : "Content-Type: application/json\r\nConnection: close\r\nContent-Length: ";
+        appendDecimal(out, json.size());
+        out += "\r\n\r\n";
+        if (request.method != "HEAD") {
+            out.append(buffer, json.size());
+        }
+    }
+    
+    // Dispatches to the routes added with addRoute(). Returns false when no
+    // pattern matches path.
+    bool routeDynamic(const HttpRequest& request, std::string_view path, OutputBuffer& out,
+                      Arena& arena) const {
+        if (router.empty()) {
+            return false;
+        }
+        RouteParams params;
+        unsigned allowed = 0;
+        const RadixRouter::Endpoint* endpoint =
+            router.find(path, methodBit(request.method), params, allowed);
+        if (endpoint != nullptr) {
+            endpoint->handler(request, params, out, arena);
+        } else if (allowed != 0) {
+            out += createErrorResponse(405, request.keep_alive, allowHeader(allowed).c_str());
+        }
+        return endpoint != nullptr || allowed != 0;
+    }
+    
+    // Merges the metric shards and appends them in Prometheus text format
+    void serveMetrics(const HttpRequest& request, OutputBuffer& out, Arena&) const {
+        std::string_view names[ROUTE_COUNT];
+        for (size_t i = 0; i < routes.size(); ++i) {
+            names[i] = routes[i].path;
+        }
+        names[ROUTE_DYNAMIC] = "dynamic";
+        names[ROUTE_FILES] = "files";
+        names[ROUTE_UNMATCHED] = "unmatched";
+        std::string body;
+        Metrics::render(body, names);
+        if (access_log) {
+            body += "# HELP xweb_access_log_dropped_total Access log records dropped because a buffer was full.\n"
+                    "# TYPE xweb_access_log_dropped_total counter\n"
+                    "xweb_access_log_dropped_total ";
+            appendDecimal(body, access_log->dropped());
+            body += '\n';
+        }
+#ifdef __linux__
+        appendListenCounters(body);
+#endif
+        appendResponse(out, request, 200, "text/plain; version=0.0.4", body);
+    }
+    
+#ifdef __linux__
+    // Appends the kernel's ListenOverflows and ListenDrops counters from
+    // /proc/net/netstat. They count connections lost because an accept
+    // queue was full, for every listener in the network namespace.
+    static void appendListenCounters(std::string& body) {
+        std::FILE* file = std::fopen("/proc/net/netstat", "re");
+        if (file == nullptr) {
+            return;
+        }
+        // "TcpExt:" lines come in pairs: field names, then values
+        char names[4096];
+        char values[4096];
+        bool found = false;
+        while (std::fgets(names, sizeof(names), file) != nullptr) {
+            if (std::strncmp(names, "TcpExt:", 7) == 0) {
+                found = std::fgets(values, sizeof(values), file) != nullptr;
+                break;
+            }
+        }
+        std::fclose(file);
+        if (!found) {
+            return;
+        }
+        
+        static const std::pair<const char*, const char*> counters[] = {
+            {"ListenOverflows", "xweb_listen_overflows_total"},
+            {"ListenDrops", "xweb_listen_drops_total"},
+        };
+        char* name_save = nullptr;
+        char* value_save = nullptr;
+        char* name = strtok_r(names, " \n", &name_save);
+        char* value = strtok_r(values, " \n", &value_save);
+        for (; name != nullptr && value != nullptr;
+             name = strtok_r(nullptr, " \n", &name_save), value = strtok_r(nullptr, " \n", &value_save)) {
+            for (const auto& counter : counters) {
+                if (std::strcmp(name, counter.first) != 0) {
+                    continue;
+                }
+                body += "# HELP ";
+                body += counter.second;
+                body += " TcpExt ";
+                body += counter.first;
+                body += " from /proc/net/netstat (whole network namespace).\n# TYPE ";
+                body += counter.second;
+                body += " counter\n";
+                body += counter.second;
+                body += ' ';
+                body += value;
+                body += '\n';
+            }
+        }
+    }
+#endif
+    
+    // Appends the HTML page in the encoding the client prefers, or a 304
+    void servePage(const HttpRequest& request, OutputBuffer& out, Arena&) const {
+        const ClockService::Snapshot& clock = ClockService::now();
+        const CachedBody::Variant& variant = html.select(request.header("Accept-Encoding"));
+        if (html.notModified(request, variant)) {
+            out += "HTTP/1.1 304 Not Modified\r\n";
+            out.append(clock.date_header, clock.date_header_length);
+            out += request.keep_alive ? variant.not_modified_keep_alive : variant.not_modified_close;
+            return;
+        }
+        out += "HTTP/1.1 200 OK\r\n";
+        out.append(clock.date_header, clock.date_header_length);
+        out += request.keep_alive ? variant.headers_keep_alive : variant.headers_close;
+        if (request.method != "HEAD") {
+            out.appendShared(variant.body);
+        }
+    }
+    
+    std::string createErrorResponse(int status, bool keep_alive = false,
+                                    const char* extra_headers = "") const {
+        const char* reason = reasonPhrase(status);
+        std::string body = std::to_string(status) + " " + reason + "\n";
+        std::ostringstream response;
+        response << "HTTP/1.1 " << status << " " << reason << "\r\n"
+                 << ClockService::now().date_header
+                 << "Content-Type: text/plain\r\n"
+                 << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n"
+                 << extra_headers
+                 << "Content-Length: " << body.length() << "\r\n"
+                 << "\r\n"
+                 << body;
+        
+        return response.str();
+    }
+
+public:
+    explicit WebServer(const ServerConfig& config = ServerConfig())
+        : config(config), server_fd(-1) {
+        // The page is rendered at startup, so that is when it last changed
+        html = CachedBody(createHtmlPage(), "text/html", config.page_cache_control, std::time(nullptr));
+        if (!config.api_cache_control.empty()) {
+            api_cache_control_header = "Cache-Control: " + config.api_cache_control + "\r\n";
+        }
+        api_template = createApiTemplate();
+        
+#ifdef _WIN32
+        if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+            throw std::runtime_error("WSAStartup failed");
+        }
+#endif
+#ifdef __linux__
+        if (!this->config.cpu_affinity.empty()) {
+            worker_cpus = parseCpuList(this->config.cpu_affinity);
+            if (this->config.workers == 0) {
+                this->config.workers = static_cast<unsigned>(worker_cpus.size());
+            }
+        }
+        if (this->config.workers == 0) {
+            this->config.workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if (!this->config.document_root.empty()) {
+            char resolved[PATH_MAX];
+            struct stat st;
+            if (realpath(this->config.document_root.c_str(), resolved) == nullptr ||
+                stat(resolved, &st) < 0 || !S_ISDIR(st.st_mode)) {
+                throw std::runtime_error("Document root is not a directory: " +
+                                         this->config.document_root);
+            }
+            this->config.document_root = resolved;
+        }
+#else
+        // SO_REUSEPORT load balancing and sendfile() are Linux-specific
+        this->config.workers = 1;
+        this->config.document_root.clear();
+#endif
+        if (this->config.pool_threads > 0) {
+            // The pool has a single acceptor and serves connections with the
+            // blocking handler, which has no sendfile() path
+            if (!this->config.document_root.empty()) {
+                throw std::invalid_argument("A document root cannot be served by the worker pool");
+            }
+            this->config.workers = 1;
+        }
+        if (this->config.io_backend == ServerConfig::IoBackend::IoUring) {
+            // The io_uring loop only serves the built-in pages
+            if (this->config.pool_threads > 0 || !this->config.document_root.empty()) {
+                throw std::invalid_argument(
+                    "The io_uring backend cannot be combined with the worker pool or a document root");
+            }
+        }
+#ifdef __linux__
+        // SIGUSR2 starts a binary upgrade (see run()). It is blocked before
+        // the first thread, the access log writer, is created, so every
+        // thread inherits the mask and only the upgrade thread receives it.
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGUSR2);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif
+        if (!this->config.access_log_path.empty()) {
+            access_log = std::make_unique<AccessLog>(this->config);
+        }
+    }
+    
+    ~WebServer() {
+        stop();
+#ifdef __linux__
+        if (drain_fd >= 0) {
+            close(drain_fd);
+        }
+#endif
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+    
+    bool start() {
+        // Configure server address
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(PORT);
+        
+        // One listener per worker; with several workers the kernel spreads
+        // incoming connections across them via SO_REUSEPORT. A shared
+        // listener is a single socket that every worker waits on.
+        bool reuse_port = config.workers > 1 && !config.shared_listener;
+        unsigned listeners = reuse_port ? config.workers : 1;
+#ifdef __linux__
+        if (!inheritListeners(listeners)) {
+            stop();
+            return false;
+        }
+        bool inherited = !listen_fds.empty();
+#endif
+        while (listen_fds.size() < listeners) {
+            int fd = createListener(reuse_port);
+            if (fd < 0) {
+                stop();
+                return false;
+            }
+            listen_fds.push_back(fd);
+        }
+        server_fd = listen_fds.front();
+#ifdef __linux__
+        // The reuseport group numbers its sockets in the order they started
+        // listening, which for inherited listeners happened in another
+        // process. The program attached there stays with the group.
+        if (!inherited) {
+            steerByCpu();
+        }
+#endif
+        
+        std::cout << "Web server started on port " << PORT;
+        if (config.pool_threads > 0) {
+            std::cout << " with a pool of " << config.pool_threads << " threads";
+        } else if (config.workers > 1) {
+            std::cout << " with " << config.workers << " workers";
+            if (config.shared_listener) {
+                std::cout << " sharing one listener";
+            }
+        }
+        std::cout << std::endl;
+#ifdef __linux__
+        notifyReady();
+#endif
+        return true;
+    }
+    
+    void run();
+    
+    // Registers handler for a path pattern such as "/api/items/{id}" or
+    // "/assets/*path" (see RadixRouter). Routes in the static table take
+    // precedence. Call before run().
+    void addRoute(unsigned methods, std::string_view pattern, RouteFunction handler) {
+        router.add(methods, pattern, std::move(handler));
+    }
+    
+    // Appends a complete response for request to out, for route handlers.
+    // HEAD requests get the headers only.
+    static void appendResponse(OutputBuffer& out, const HttpRequest& request, int status,
+                               std::string_view content_type, std::string_view body) {
+        const ClockService::Snapshot& clock = ClockService::now();
+        out += "HTTP/1.1 ";
+        appendDecimal(out, status);
+        out += " ";
+        out += reasonPhrase(status);
+        out += "\r\n";
+        out.append(clock.date_header, clock.date_header_length);
+        out += "Content-Type: ";
+        out += content_type;
+        out += request.keep_alive ? "\r\nConnection: keep-alive\r\nContent-Length: "
+                                  : "\r\nConnection: close\r\nContent-Length: ";
+        appendDecimal(out, body.size());
+        out += "\r\n\r\n";
+        if (request.method != "HEAD") {
+            out += body;
+        }
+    }
+
+private:
+    friend class EventLoop;
+    friend class UringLoop;
+    friend class WorkerPool;
+    friend int bench::runAllocations();
+    friend int bench::routeRaw(const WebServer& server, std::string_view raw, OutputBuffer& out);
+    
+    // Runs the loops, or the pool, until they have drained
+    void serve();
+    
+#ifdef __linux__
+    // Runs event loop number worker on fd with the configured backend
+    void runLoop(int fd, unsigned worker) const;
+    
+    // Environment of a process started by upgrade(): its listeners, and
+    // the pipe on which it reports having adopted them
+    static constexpr const char* LISTEN_FDS_ENV = "XWEB_LISTEN_FDS";
+    static constexpr const char* READY_FD_ENV = "XWEB_READY_FD";
+    // How long the new process may take to start before it is killed
+    static constexpr int UPGRADE_TIMEOUT_MS = 30000;
+    
+    // Adopts the listeners handed down by the process this one replaces,
+    // if any. More listeners than the configuration needs cannot be given
+    // back, so that fails; start() creates any that are missing.
+    bool inheritListeners(unsigned listeners) {
+        const char* list = std::getenv(LISTEN_FDS_ENV);
+        if (list == nullptr) {
+            return true;
+        }
+        std::istringstream fds(list);
+        std::string fd;
+        while (std::getline(fds, fd, ',')) {
+            listen_fds.push_back(std::atoi(fd.c_str()));
+            fcntl(listen_fds.back(), F_SETFD, FD_CLOEXEC);
+        }
+        unsetenv(LISTEN_FDS_ENV);
+        if (listen_fds.size() > listeners) {
+            std::cerr << "Inherited " << listen_fds.size() << " listeners but the configuration uses "
+                      << listeners << std::endl;
+            return false;
+        }
+        std::cout << "Took over " << listen_fds.size() << " listeners" << std::endl;
+        return true;
+    }
+    
+    // Tells the process that started this one that it may drain
+    static void notifyReady() {
+        const char* fd = std::getenv(READY_FD_ENV);
+        if (fd == nullptr) {
+            return;
+        }
+        int ready = std::atoi(fd);
+        unsetenv(READY_FD_ENV);
+        char byte = 1;
+        if (write(ready, &byte, 1) != 1) {
+            std::cerr << "Cannot notify the previous process: " << std::strerror(errno) << std::endl;
+        }
+        close(ready);
+    }
+    
+    // The program to run is looked up again from argv[0], like the shell
+    // did, rather than taken from /proc/self/exe: a deploy replaces the
+    // file at that path, and /proc/self/exe still names the old one
+    static std::string findProgram(const std::string& name) {
+        if (name.find('/') != std::string::npos) {
+            return name;
+        }
+        const char* path = std::getenv("PATH");
+        std::istringstream dirs(path != nullptr ? path : "");
+        std::string dir;
+        while (std::getline(dirs, dir, ':')) {
+            std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+            if (access(candidate.c_str(), X_OK) == 0) {
+                return candidate;
+            }
+        }
+        return name;
+    }
+    
+    // Starts the program again with this process's command line, passing
+    // the listeners down as inherited descriptors. Connections keep
+    // queueing on them throughout, so none is refused. Returns true once
+    // the new process has adopted them and this one should drain; on false
+    // this process carries on serving alone.
+    bool upgrade() const {
+        // Read and closed before fork(), like every descriptor but the
+        // listeners, which are the only ones the new process inherits
+        std::vector<std::string> args;
+        {
+            std::ifstream cmdline("/proc/self/cmdline", std::ios::binary);
+            std::string arg;
+            while (std::getline(cmdline, arg, '\0')) {
+                args.push_back(arg);
+            }
+        }
+        if (args.empty()) {
+            std::cerr << "Upgrade failed: cannot read the command line" << std::endl;
+            return false;
+        }
+        std::string program = findProgram(args.front());
+        
+        int ready[2];
+        if (pipe2(ready, O_CLOEXEC) < 0) {
+            std::cerr << "Upgrade failed: pipe2: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        
+        // Everything the child needs is built here: between fork() and exec
+        // only async-signal-safe calls are allowed
+        std::string fds_prefix = std::string(LISTEN_FDS_ENV) + "=";
+        std::string ready_prefix = std::string(READY_FD_ENV) + "=";
+        std::string fds = fds_prefix;
+        for (size_t i = 0; i < listen_fds.size(); ++i) {
+            fds += (i == 0 ? "" : ",") + std::to_string(listen_fds[i]);
+        }
+        std::string ready_fd = ready_prefix + std::to_string(ready[1]);
+        std::vector<char*> argv;
+        for (std::string& value : args) {
+            argv.push_back(&value[0]);
+        }
+        argv.push_back(nullptr);
+        std::vector<char*> envp;
+        for (char** var = environ; *var != nullptr; ++var) {
+            std::string_view entry(*var);
+            if (entry.rfind(fds_prefix, 0) != 0 && entry.rfind(ready_prefix, 0) != 0) {
+                envp.push_back(*var);
+            }
+        }
+        envp.push_back(&fds[0]);
+        envp.push_back(&ready_fd[0]);
+        envp.push_back(nullptr);
+        
+        pid_t pid = fork();
+        if (pid == 0) {
+            // This thread blocks SIGUSR2, and exec keeps the mask
+            sigset_t none;
+            sigemptyset(&none);
+            sigprocmask(SIG_SETMASK, &none, nullptr);
+            for (int fd : listen_fds) {
+                fcntl(fd, F_SETFD, 0);
+            }
+            fcntl(ready[1], F_SETFD, 0);
+            execve(program.c_str(), argv.data(), envp.data());
+            _exit(127);
+        }
+        close(ready[1]);
+        if (pid < 0) {
+            close(ready[0]);
+            std::cerr << "Upgrade failed: fork: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        
+        // One byte once the listeners are adopted; end of file if the new
+        // process fails to exec or to start
+        pollfd wait = {ready[0], POLLIN, 0};
+        int polled;
+        do {
+            polled = poll(&wait, 1, UPGRADE_TIMEOUT_MS);
+        } while (polled < 0 && errno == EINTR);
+        char byte = 0;
+        bool adopted = polled > 0 && read(ready[0], &byte, 1) == 1;
+        close(ready[0]);
+        if (!adopted) {
+            // Never leave a half-started server running beside this one
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+            std::cerr << "Upgrade failed: process " << pid << " did not take over" << std::endl;
+            return false;
+        }
+        std::cout << "Process " << pid << " took over the listeners; draining" << std::endl;
+        return true;
+    }
+    
+    // Runs on its own thread until done is set: each SIGUSR2 starts an
+    // upgrade, and the first that succeeds wakes the loops to drain
+    void awaitUpgrade(const sigset_t& signals, const std::atomic<bool>& done) const {
+        while (true) {
+            int signal = 0;
+            sigwait(&signals, &signal);
+            if (done.load()) {
+                return;
+            }
+            if (upgrade()) {
+                uint64_t one = 1;
+                if (write(drain_fd, &one, sizeof(one)) < 0) {
+                    std::cerr << "Cannot wake the event loops: " << std::strerror(errno) << std::endl;
+                }
+                return;
+            }
+        }
+    }
+    
+    // Expands a list like "0-3,8" into CPU numbers; "auto" lists the CPUs
+    // the process may run on
+    static std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        if (list == "auto") {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+                throw std::runtime_error("sched_getaffinity failed");
+            }
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+            return cpus;
+        }
+        std::istringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            char* end = nullptr;
+            long first = std::strtol(range.c_str(), &end, 10);
+            long last = first;
+            if (end != range.c_str() && *end == '-') {
+                const char* start = end + 1;
+                last = std::strtol(start, &end, 10);
+                if (end == start) {
+                    end = nullptr;
+                }
+            }
+            if (range.empty() || !std::isdigit(static_cast<unsigned char>(range[0])) ||
+                end == nullptr || *end != '\0' || last < first || last >= CPU_SETSIZE) {
+                throw std::invalid_argument("Invalid CPU list: " + list);
+            }
+            for (long cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        if (cpus.empty()) {
+            throw std::invalid_argument("Invalid CPU list: " + list);
+        }
+        return cpus;
+    }
+    
+    // Binds the calling thread to the CPU of its event loop. Its memory
+    // policy is set to local allocation, so the pages the loop touches first
+    // (connection tables, arenas, buffers) come from that CPU's NUMA node
+    // even when the process was started with an interleave policy.
+    void pinWorker(unsigned worker) const {
+        if (worker_cpus.empty()) {
+            return;
+        }
+        int cpu = worker_cpus[worker % worker_cpus.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            throw std::runtime_error("Cannot pin worker " + std::to_string(worker) + " to CPU " +
+                                     std::to_string(cpu) + ": " + std::strerror(errno));
+        }
+        // Warns rather than fails, like a rejected socket option: the loop
+        // still runs, with memory placed by the inherited policy
+        if (syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) != 0) {
+            std::cerr << "set_mempolicy(MPOL_LOCAL) failed for worker " << worker << ": "
+                      << std::strerror(errno) << std::endl;
+        }
+    }
+    
+    // Steers each connection to the SO_REUSEPORT listener of the worker
+    // pinned to the CPU that received its SYN, so the connection's softirq
+    // processing and its event loop share a core and its caches. The
+    // classic BPF program maps the current CPU to a listener index: one
+    // comparison per pinned CPU, then CPU modulo the listener count for
+    // CPUs without a worker.
+    void steerByCpu() const {
+        if (worker_cpus.empty() || listen_fds.size() < 2) {
+            return;
+        }
+        std::vector<sock_filter> program;
+        program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+        for (unsigned worker = 0; worker < listen_fds.size() && worker < worker_cpus.size(); ++worker) {
+            program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                       static_cast<uint32_t>(worker_cpus[worker]), 0, 1));
+            program.push_back(BPF_STMT(BPF_RET | BPF_K, worker));
+        }
+        program.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(listen_fds.size())));
+        program.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+        
+        sock_fprog filter = {static_cast<unsigned short>(program.size()), program.data()};
+        // The program belongs to the port's reuseport group, so attaching
+        // it to one listener covers all of them
+        if (setsockopt(listen_fds.front(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &filter,
+                       sizeof(filter)) < 0) {
+            std::cerr << "Setsockopt SO_ATTACH_REUSEPORT_CBPF failed: " << std::strerror(errno)
+                      << std::endl;
+        }
+    }
+#endif
+
+    int createListener(bool reuse_port) {
+        // Create socket
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            std::cerr << "Socket creation failed" << std::endl;
+            return -1;
+        }
+        
+        // Set socket options
+        int opt = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, 
+                      reinterpret_cast<char*>(&opt), sizeof(opt)) < 0) {
+            std::cerr << "Setsockopt failed" << std::endl;
+            closeSocket(fd);
+            return -1;
+        }
+#ifdef SO_REUSEPORT
+        if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+                                     reinterpret_cast<char*>(&opt), sizeof(opt)) < 0) {
+            std::cerr << "Setsockopt SO_REUSEPORT failed" << std::endl;
+            closeSocket(fd);
+            return -1;
+        }
+#else
+        (void)reuse_port;
+#endif
+        // Before listen(): the buffer sizes set the window scale offered in
+        // the handshake, and Fast Open must be enabled first
+        applySocketOptions(fd);
+        
+        // Bind socket
+        if (bind(fd, reinterpret_cast<struct sockaddr*>(&server_addr), 
+                sizeof(server_addr)) < 0) {
+            std::cerr << "Bind failed" << std::endl;
+            closeSocket(fd);
+            return -1;
+        }
+        
+        // Listen for connections
+        if (listen(fd, listenBacklog()) < 0) {
+            std::cerr << "Listen failed" << std::endl;
+            closeSocket(fd);
+            return -1;
+        }
+        
+        return fd;
+    }
+    
+    // Warns rather than fails: a rejected option only loses its tuning
+    static void setOption(int fd, int level, int option, int value, const char* name) {
+        if (setsockopt(fd, level, option, reinterpret_cast<char*>(&value), sizeof(value)) < 0) {
+            std::cerr << "Setsockopt " << name << " failed: " << std::strerror(errno) << std::endl;
+        }
+    }
+    
+    void applySocketOptions(int fd) const {
+        const SocketOptions& options = config.socket_options;
+        if (options.tcp_nodelay) {
+            setOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+        }
+        if (options.send_buffer > 0) {
+            setOption(fd, SOL_SOCKET, SO_SNDBUF, options.send_buffer, "SO_SNDBUF");
+        }
+        if (options.receive_buffer > 0) {
+            setOption(fd, SOL_SOCKET, SO_RCVBUF, options.receive_buffer, "SO_RCVBUF");
+        }
+#ifdef TCP_DEFER_ACCEPT
+        if (options.defer_accept > 0) {
+            setOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options.defer_accept, "TCP_DEFER_ACCEPT");
+        }
+#endif
+#ifdef TCP_FASTOPEN
+        if (options.fastopen_queue > 0) {
+            setOption(fd, IPPROTO_TCP, TCP_FASTOPEN, options.fastopen_queue, "TCP_FASTOPEN");
+        }
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+        if (options.notsent_lowat > 0) {
+            setOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.notsent_lowat, "TCP_NOTSENT_LOWAT");
+        }
+#endif
+#ifdef SO_BUSY_POLL
+        if (options.busy_poll > 0) {
+            setOption(fd, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll, "SO_BUSY_POLL");
+        }
+#endif
+    }
+    
+    int listenBacklog() const {
+        if (config.listen_backlog > 0) {
+            return config.listen_backlog;
+        }
+#ifdef __linux__
+        // Larger values are silently capped to this by the kernel
+        if (std::FILE* file = std::fopen("/proc/sys/net/core/somaxconn", "re")) {
+            int somaxconn = 0;
+            bool read = std::fscanf(file, "%d", &somaxconn) == 1;
+            std::fclose(file);
+            if (read && somaxconn > 0) {
+                return somaxconn;
+            }
+        }
+#endif
+        return SOMAXCONN;
+    }
+    
+    static void closeSocket(int fd) {
+#ifdef _WIN32
+        closesocket(fd);
+#else
+        close(fd);
+#endif
+    }
+    
+    void runBlocking() {
+        while (true) {
+            struct sockaddr_in client_addr;
+#ifdef _WIN32
+            int client_len = sizeof(client_addr);
+#else
+            socklen_t client_len = sizeof(client_addr);
+#endif
+            
+            int client_fd = accept(server_fd, 
+                                 reinterpret_cast<struct sockaddr*>(&client_addr), 
+                                 &client_len);
+            
+            if (client_fd < 0) {
+                std::cerr << "Accept failed" << std::endl;
+                continue;
+            }
+            
+            handleClient(client_fd);
+            
+#ifdef _WIN32
+            closesocket(client_fd);
+#else
+            close(client_fd);
+#endif
+        }
+    }
+    
+    void handleClient(int client_fd) const {
+        char buffer[BUFFER_SIZE];
+        std::string data;
+        HttpParser parser(config.limits);
+        HttpRequest request;
+        Arena arena;
+        Metrics::Tracker metrics;
+        
+        // A client that never finishes its request must not hold the
+        // thread forever. Each wait is bounded by the socket timeouts; the
+        // header block and the body also have deadlines that a client
+        // trickling bytes cannot extend.
+        setTimeout(client_fd, SO_RCVTIMEO, config.keep_alive_timeout);
+        setTimeout(client_fd, SO_SNDTIMEO, config.write_timeout);
+        
+        // The blocking loop serves one request per connection
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point deadline;
+        bool reading_body = false;
+        HttpParser::Result result = HttpParser::Result::Incomplete;
+        while (result == HttpParser::Result::Incomplete) {
+            int bytes_received = recv(client_fd, buffer, sizeof(buffer), 0);
+            if (bytes_received <= 0) {
+                return;
+            }
+            if (data.empty()) {
+                deadline = Clock::now() + std::chrono::seconds(config.header_timeout);
+            }
+            data.append(buffer, static_cast<size_t>(bytes_received));
+            uint64_t parse_start = Metrics::now();
+            result = parser.parse(data.data(), data.size(), request, arena);
+            metrics.parsed(parse_start, Metrics::now());
+            if (result != HttpParser::Result::Incomplete) {
+                break;
+            }
+            if (parser.readingBody() && !reading_body) {
+                reading_body = true;
+                deadline = Clock::now() + std::chrono::seconds(config.body_timeout);
+            } else if (Clock::now() >= deadline) {
+                return;
+            }
+        }
+        
+        OutputBuffer response;
+        uint64_t handler_start = Metrics::now();
+        size_t route = ROUTE_UNMATCHED;
+        if (result == HttpParser::Result::Error) {
+            response += createErrorResponse(parser.errorStatus());
+        } else {
+            request.keep_alive = false;
+            route = routeRequest(request, response, arena);
+        }
+        int status = Metrics::statusAt(response, 0);
+        metrics.responded(route, status, handler_start);
+        if (access_log) {
+            access_log->log(result == HttpParser::Result::Complete ? &request : nullptr,
+                            peerAddress(client_fd), status, AccessLog::bodyBytes(response, 0));
+        }
+        
+        // One blocking call in the common case, so first byte and write
+        // complete together
+        sendAll(client_fd, response);
+        metrics.wrote();
+        metrics.drained();
+    }
+    
+    static void setTimeout(int fd, int option, unsigned seconds) {
+#ifdef _WIN32
+        DWORD timeout = seconds * 1000;
+#else
+        struct timeval timeout = {static_cast<time_t>(seconds), 0};
+#endif
+        setsockopt(fd, SOL_SOCKET, option, reinterpret_cast<char*>(&timeout), sizeof(timeout));
+    }
+    
+    // Client IPv4 address for the access log, 0 when it is not IPv4
+    static uint32_t peerAddress(int fd) {
+        struct sockaddr_in address = {};
+#ifdef _WIN32
+        int length = sizeof(address);
+#else
+        socklen_t length = sizeof(address);
+#endif
+        if (getpeername(fd, reinterpret_cast<struct sockaddr*>(&address), &length) != 0 ||
+            address.sin_family != AF_INET) {
+            return 0;
+        }
+        return address.sin_addr.s_addr;
+    }
+    
+    // Writes all of out to a blocking socket
+    static void sendAll(int fd, OutputBuffer& out) {
+        while (out.sent() < out.size()) {
+#ifdef _WIN32
+            int n = -1;
+            out.forEachPending(out.size(), [&](const char* piece, size_t length) {
+                n = send(fd, piece, static_cast<int>(length), SEND_FLAGS);
+                return false;
+            });
+#else
+            struct iovec iov[MAX_IOVECS];
+            struct msghdr message = {};
+            message.msg_iov = iov;
+            message.msg_iovlen = out.gather(iov, MAX_IOVECS, out.size());
+            ssize_t n = sendmsg(fd, &message, SEND_FLAGS);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            if (n <= 0) {
+                return;
+            }
+            out.consume(static_cast<size_t>(n));
+        }
+    }
+    
+    // Appends the response for request to out, using arena for scratch
+    // memory, and returns the route that took it (see ROUTE_COUNT).
+    // ROUTE_FILES means nothing was appended: the request should be served
+    // from the document root instead.
+    size_t routeRequest(const HttpRequest& request, OutputBuffer& out, Arena& arena) const {
+        std::string_view path = request.target.substr(0, request.target.find_first_of("?#"));
+        const StaticRoute* route = routes.find(path);
+        // With a document root, its index.html replaces the built-in page
+        bool files = !config.document_root.empty();
+        if (route == nullptr || (files && route->handler == &WebServer::servePage)) {
+            if (routeDynamic(request, path, out, arena)) {
+                return ROUTE_DYNAMIC;
+            }
+            if (files) {
+                return ROUTE_FILES;
+            }
+            out += createErrorResponse(404, request.keep_alive);
+            return ROUTE_UNMATCHED;
+        }
+        if ((route->methods & methodBit(request.method)) == 0) {
+            out += createErrorResponse(405, request.keep_alive, allowHeader(route->methods).c_str());
+        } else {
+            (this->*route->handler)(request, out, arena);
+        }
+        return routes.indexOf(route);
+    }
+    
+    void stop() {
+        for (int fd : listen_fds) {
+            closeSocket(fd);
+        }
+        listen_fds.clear();
+        server_fd = -1;
+    }
+};
+
+constexpr StaticRouteTable<STATIC_ROUTE_COUNT> WebServer::routes({
+    {"/", METHOD_GET | METHOD_HEAD, &WebServer::servePage},
+    {"/api", METHOD_GET | METHOD_HEAD, &WebServer::serveApi},
+    {"/metrics", METHOD_GET | METHOD_HEAD, &WebServer::serveMetrics},
+});
+
+// Alternative to the per-core event loops for CPU-heavy handlers: one thread
+// accepts connections and hands them to a fixed set of worker threads over a
+// bounded lock-free queue, so a slow handler never stalls accept(). Workers
+// serve each connection with the blocking handleClient() path. A full queue
+// means every worker is busy and pool_queue_depth clients are already
+// waiting; the acceptor then either answers 503 straight away or stops
+// accepting until a worker frees a slot, leaving new clients in the kernel's
+// listen backlog.
+class WorkerPool {
+private:
+    const WebServer& server;
+    int listen_fd;
+    MpmcQueue<int> queue;
+    // Workers sleep here while the queue is empty
+    Parking not_empty;
+    // The acceptor sleeps here while the queue is full (Overflow::Block)
+    Parking not_full;
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+    
+    void work() {
+        while (true) {
+            int client_fd = -1;
+            if (!queue.tryPop(client_fd)) {
+                not_empty.wait([&]() { return queue.tryPop(client_fd) || !running.load(); });
+                if (client_fd < 0) {
+                    return;
+                }
+            }
+            not_full.notifyOne();
+            
+            try {
+                server.handleClient(client_fd);
+            } catch (const std::exception& e) {
+                std::cerr << "Worker error: " << e.what() << std::endl;
+            }
+            WebServer::closeSocket(client_fd);
+        }
+    }
+    
+    void dispatch(int client_fd) {
+        if (!queue.tryPush(client_fd)) {
+            if (server.config.pool_overflow == ServerConfig::Overflow::Reject) {
+                std::string response = server.createErrorResponse(503, false, "Retry-After: 1\r\n");
+                send(client_fd, response.c_str(), response.length(), SEND_FLAGS);
+#ifdef MSG_DONTWAIT
+                // Closing with the request still unread would reset the
+                // connection and could discard the 503 before the client
+                // reads it
+                char buffer[BUFFER_SIZE];
+                shutdown(client_fd, SHUT_WR);
+                while (recv(client_fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+                }
+#endif
+                WebServer::closeSocket(client_fd);
+                return;
+            }
+            not_full.wait([&]() { return queue.tryPush(client_fd); });
+        }
+        not_empty.notifyOne();
+    }
+    
+public:
+    WorkerPool(const WebServer& server, int listen_fd)
+        : server(server), listen_fd(listen_fd), queue(server.config.pool_queue_depth) {}
+    
+    ~WorkerPool() {
+        running.store(false);
+        not_empty.notifyAll();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        int client_fd;
+        while (queue.tryPop(client_fd)) {
+            WebServer::closeSocket(client_fd);
+        }
+    }
+    
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    
+    // Starts the workers and accepts on the calling thread
+    void run() {
+        for (unsigned i = 0; i < server.config.pool_threads; ++i) {
+            threads.emplace_back([this]() { work(); });
+        }
+        
+#ifdef __linux__
+        // Another process may take a connection between poll() and
+        // accept(), which then must not block. Accepted sockets do not
+        // inherit O_NONBLOCK.
+        fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+        while (true) {
+#ifdef __linux__
+            // Stop accepting once a new process has taken over the
+            // listener; the destructor finishes the queued connections
+            pollfd fds[2] = {{listen_fd, POLLIN, 0}, {server.drain_fd, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                continue;
+            }
+            if (fds[1].revents != 0) {
+                return;
+            }
+#endif
+#ifdef __linux__
+            // Close-on-exec, so a binary upgrade does not leak the client
+            // into the new process
+            int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+#else
+            int client_fd = accept(listen_fd, nullptr, nullptr);
+#endif
+            if (client_fd < 0) {
+#ifdef __linux__
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED || errno == EINTR) {
+                    continue;
+                }
+#endif
+                std::cerr << "Accept failed" << std::endl;
+                continue;
+            }
+            dispatch(client_fd);
+        }
+    }
+};
+
+// Hierarchical timing wheel for connection deadlines, one per event loop.
+// Timers are list nodes embedded in the connection, so arming, moving and
+// cancelling one is O(1) and never allocates. Level 0 has one slot per
+// 100 ms tick; each of the three levels above covers 64 times the span of
+// the one below, about 19 days in total, and its slots are cascaded down as
+// the wheel turns. Deadlines are in ticks counted from now(), which trails
+// the clock by up to a tick, so ticks() adds one; timers then fire up to two
+// ticks late, never early.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr Clock::duration TICK = std::chrono::milliseconds(100);
+    
+    class Timer {
+    public:
+        Timer() = default;
+        // Owners are moved into their container before a timer is armed, so
+        // a moved timer starts out unarmed
+        Timer(Timer&&) noexcept {}
+        Timer& operator=(Timer&&) = delete;
+        
+        ~Timer() {
+            cancel();
+        }
+        
+        bool armed() const {
+            return next != nullptr;
+        }
+        
+        uint64_t expiry() const {
+            return deadline;
+        }
+        
+        void cancel() {
+            if (next != nullptr) {
+                prev->next = next;
+                next->prev = prev;
+                prev = next = nullptr;
+            }
+        }
+        
+    private:
+        friend class TimerWheel;
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t deadline = 0;
+        uint64_t key = 0;
+    };
+    
+    TimerWheel() : start(Clock::now()) {
+        for (auto& level : slots) {
+            for (Timer& head : level) {
+                head.prev = head.next = &head;
+            }
+        }
+    }
+    
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    
+    ~TimerWheel() {
+        // Detach any timers that outlive the wheel
+        for (auto& level : slots) {
+            for (Timer& head : level) {
+                while (head.next != &head) {
+                    head.next->cancel();
+                }
+                head.prev = head.next = nullptr;
+            }
+        }
+    }
+    
+    // Ticks to add to now() for a deadline at least seconds from the
+    // present, including the one now() may trail by
+    static uint64_t ticks(unsigned seconds) {
+        return seconds * static_cast<uint64_t>(std::chrono::seconds(1) / TICK) + 1;
+    }
+    
+    // The last tick advance() processed; cheap enough to read on every I/O
+    uint64_t now() const {
+        return current;
+    }
+    
+    // Start of the next tick, for sizing the poll timeout
+    Clock::time_point nextTick() const {
+        return start + TICK * (current + 1);
+    }
+    
+    bool empty() const {
+        for (const auto& level : slots) {
+            for (const Timer& head : level) {
+                if (head.next != &head) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    
+    // (Re)arms timer to fire at the given tick, passing key to advance()'s
+    // callback. Past deadlines fire on the next tick.
+    void schedule(Timer& timer, uint64_t deadline, uint64_t key) {
+        timer.cancel();
+        timer.deadline = std::max(deadline, current + 1);
+        timer.key = key;
+        insert(timer, current + 1);
+    }
+    
+    // Processes every tick up to time, calling expire(key) for each timer
+    // that fell due. The timer is disarmed first; the callback may re-arm it
+    // and may cancel or destroy other timers.
+    template <typename Expire>
+    void advance(Clock::time_point time, Expire expire) {
+        uint64_t target = static_cast<uint64_t>((time - start) / TICK);
+        while (current < target) {
+            uint64_t tick = current + 1;
+            size_t index = tick & SLOT_MASK;
+            // Pull the timers of the next span of each level down
+            for (size_t level = 1; level < LEVELS && index == 0; ++level) {
+                index = (tick >> (level * SLOT_BITS)) & SLOT_MASK;
+                cascade(slots[level][index], tick);
+            }
+            
+            current = tick;
+            Timer due;
+            splice(slots[0][current & SLOT_MASK], due);
+            while (due.next != &due) {
+                Timer* timer = due.next;
+                timer->cancel();
+                expire(timer->key);
+            }
+            due.prev = due.next = nullptr;
+        }
+    }
+    
+private:
+    static constexpr size_t SLOT_BITS = 6;
+    static constexpr size_t SLOTS = size_t{1} << SLOT_BITS;
+    static constexpr size_t SLOT_MASK = SLOTS - 1;
+    static constexpr size_t LEVELS = 4;
+    static constexpr uint64_t MAX_SPAN = (uint64_t{1} << (SLOT_BITS * LEVELS)) - 1;
+    
+    Clock::time_point start;
+    uint64_t current = 0;
+    Timer slots[LEVELS][SLOTS];
+    
+    // Files the timer in the lowest level whose span, counted from the next
+    // tick to process, reaches its deadline
+    void insert(Timer& timer, uint64_t next) {
+        uint64_t delta = timer.deadline - next;
+        if (delta > MAX_SPAN) {
+            timer.deadline = next + MAX_SPAN;
+            delta = MAX_SPAN;
+        }
+        size_t level = 0;
+        while (level + 1 < LEVELS && delta >= (uint64_t{1} << ((level + 1) * SLOT_BITS))) {
+            ++level;
+        }
+        Timer& head = slots[level][(timer.deadline >> (level * SLOT_BITS)) & SLOT_MASK];
+        timer.prev = head.prev;
+        timer.next = &head;
+        head.prev->next = &timer;
+        head.prev = &timer;
+    }
+    
+    // Moves the whole list at from into the empty sentinel to
+    static void splice(Timer& from, Timer& to) {
+        if (from.next == &from) {
+            to.prev = to.next = &to;
+            return;
+        }
+        to.next = from.next;
+        to.prev = from.prev;
+        to.next->prev = &to;
+        to.prev->next = &to;
+        from.prev = from.next = &from;
+    }
+    
+    void cascade(Timer& head, uint64_t next) {
+        Timer pending;
+        splice(head, pending);
+        while (pending.next != &pending) {
+            Timer* timer = pending.next;
+            timer->cancel();
+            insert(*timer, next);
+        }
+        pending.prev = pending.next = nullptr;
+    }
+};
+
+#ifdef __linux__
+// Open file descriptors for the document root, kept per event loop so hot
+// files skip open() and fstat(). An entry is trusted for one second, then
+// revalidated with a single stat() of the path; a changed file is reopened.
+class FileCache {
+public:
+    struct File {
+        int fd = -1;
+        size_t size = 0;
+        dev_t device = 0;
+        ino_t inode = 0;
+        struct timespec mtime = {};
+        const char* content_type = "application/octet-stream";
+        // Validators, formatted once when the file is opened
+        std::string etag;
+        std::string last_modified;
+        
+        ~File() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    };
+    
+    FileCache(const std::string& root, size_t capacity) : root(root), capacity(capacity) {}
+    
+    // Value of one hex digit, or -1 for any other character
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+    
+    // Maps a request target to a path relative to the document root.
+    // Drops the query, decodes %XX escapes and resolves "." and "..".
+    // Returns 0 on success, or the HTTP status for targets that are
+    // malformed, would leave the root or refer to hidden files.
+    static int normalizePath(std::string_view target, ArenaString& path) {
+        size_t query = target.find_first_of("?#");
+        if (query != std::string_view::npos) {
+            target = target.substr(0, query);
+        }
+        if (target.empty() || target.front() != '/') {
+            return 400;
+        }
+        
+        ArenaString decoded(path.get_allocator());
+        decoded.reserve(target.size());
+        for (size_t i = 0; i < target.size(); ++i) {
+            char c = target[i];
+            if (c == '%') {
+                int high = i + 2 < target.size() ? hexValue(target[i + 1]) : -1;
+                int low = i + 2 < target.size() ? hexValue(target[i + 2]) : -1;
+                if (high < 0 || low < 0) {
+                    return 400;
+                }
+                c = static_cast<char>(high * 16 + low);
+                if (c == '\0') {
+                    return 400;
+                }
+                i += 2;
+            }
+            decoded += c;
+        }
+        
+        path.clear();
+        size_t pos = 0;
+        while (pos <= decoded.size()) {
+            size_t slash = decoded.find('/', pos);
+            if (slash == std::string::npos) {
+                slash = decoded.size();
+            }
+            std::string_view segment(decoded.data() + pos, slash - pos);
+            if (segment == "..") {
+                if (path.empty()) {
+                    return 403;
+                }
+                size_t parent = path.rfind('/');
+                path.erase(parent == std::string::npos ? 0 : parent);
+            } else if (!segment.empty() && segment != ".") {
+                if (segment.front() == '.') {
+                    return 404;
+                }
+                if (!path.empty()) {
+                    path += '/';
+                }
+                path.append(segment.data(), segment.size());
+            }
+            pos = slash + 1;
+        }
+        
+        // Directory targets serve their index page
+        if (decoded.back() == '/') {
+            path += path.empty() ? "index.html" : "/index.html";
+        }
+        return 0;
+    }
+    
+    // Returns the open file for a normalized path, or nullptr with status
+    // set to the HTTP error to send
+    std::shared_ptr<File> lookup(std::string_view path, int& status) {
+        auto now = std::chrono::steady_clock::now();
+        // The map needs a std::string key; reuse one buffer for it
+        key.assign(path.data(), path.size());
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            Entry& entry = it->second;
+            if (now - entry.validated < std::chrono::seconds(1)) {
+                return entry.file;
+            }
+            struct stat st;
+            full_path.assign(root).append("/").append(key);
+            if (stat(full_path.c_str(), &st) == 0 && st.st_dev == entry.file->device &&
+                st.st_ino == entry.file->inode && static_cast<size_t>(st.st_size) == entry.file->size &&
+                st.st_mtim.tv_sec == entry.file->mtime.tv_sec &&
+                st.st_mtim.tv_nsec == entry.file->mtime.tv_nsec) {
+                entry.validated = now;
+                return entry.file;
+            }
+            entries.erase(it);
+        }
+        
+        std::shared_ptr<File> file = open(key, status);
+        if (file) {
+            if (entries.size() >= capacity) {
+                // No recency tracking; any entry will do
+                entries.erase(entries.begin());
+            }
+            entries[key] = Entry{file, now};
+        }
+        return file;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<File> file;
+        std::chrono::steady_clock::time_point validated;
+    };
+    
+    std::string root;
+    size_t capacity;
+    std::unordered_map<std::string, Entry> entries;
+    // Scratch strings kept across lookups to avoid reallocating them
+    std::string key;
+    std::string full_path;
+    
+    // Whether an absolute, resolved path lies below the root. With "/" as
+    // the root every path does.
+    bool insideRoot(const char* path) const {
+        if (root == "/") {
+            return path[0] == '/';
+        }
+        return std::strncmp(path, root.c_str(), root.size()) == 0 && path[root.size()] == '/';
+    }
+    
+    std::shared_ptr<File> open(const std::string& path, int& status) {
+        std::string full = root + "/" + path;
+        
+        // Symlinks must not lead out of the document root
+        char resolved[PATH_MAX];
+        if (realpath(full.c_str(), resolved) == nullptr) {
+            status = errno == EACCES ? 403 : 404;
+            return nullptr;
+        }
+        if (!insideRoot(resolved)) {
+            status = 403;
+            return nullptr;
+        }
+        
+        // A link swapped in after realpath() could still lead out: the last
+        // component must not be one, and the file actually opened is checked
+        // again through its /proc/self/fd entry, which covers directories
+        // swapped higher up the path
+        auto file = std::make_shared<File>();
+        file->fd = ::open(resolved, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (file->fd < 0) {
+            status = errno == EACCES ? 403 : 404;
+            return nullptr;
+        }
+        std::string link = "/proc/self/fd/" + std::to_string(file->fd);
+        ssize_t length = readlink(link.c_str(), resolved, sizeof(resolved) - 1);
+        if (length < 0) {
+            status = 403;
+            return nullptr;
+        }
+        resolved[length] = '\0';
+        if (!insideRoot(resolved)) {
+            status = 403;
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(file->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            status = 404;
+            return nullptr;
+        }
+        file->size = static_cast<size_t>(st.st_size);
+        file->device = st.st_dev;
+        file->inode = st.st_ino;
+        file->mtime = st.st_mtim;
+        file->content_type = contentType(path);
+        // Modification time and size, as most servers do: hashing the
+        // contents would mean reading every file on open
+        char etag[64];
+        std::snprintf(etag, sizeof(etag), "\"%llx.%lx-%zx\"",
+                      static_cast<unsigned long long>(st.st_mtim.tv_sec),
+                      static_cast<unsigned long>(st.st_mtim.tv_nsec), file->size);
+        file->etag = etag;
+        file->last_modified = ClockService::formatHttpDate(st.st_mtim.tv_sec);
+        return file;
+    }
+    
+    static const char* contentType(const std::string& path) {
+        static const std::pair<const char*, const char*> types[] = {
+            {".html", "text/html"}, {".htm", "text/html"}, {".css", "text/css"},
+            {".js", "text/javascript"}, {".mjs", "text/javascript"}, {".json", "application/json"},
+            {".txt", "text/plain"}, {".xml", "application/xml"}, {".svg", "image/svg+xml"},
+            {".png", "image/png"}, {".jpg", "image/jpeg"}, {".jpeg", "image/jpeg"},
+            {".gif", "image/gif"}, {".webp", "image/webp"}, {".avif", "image/avif"},
+            {".ico", "image/x-icon"}, {".woff", "font/woff"}, {".woff2", "font/woff2"},
+            {".wasm", "application/wasm"}, {".pdf", "application/pdf"},
+        };
+        size_t dot = path.rfind('.');
+        if (dot != std::string::npos && path.find('/', dot) == std::string::npos) {
+            std::string_view extension(path.data() + dot, path.size() - dot);
+            for (const auto& type : types) {
+                if (equalsIgnoreCase(extension, type.first)) {
+                    return type.second;
+                }
+            }
+        }
+        return "application/octet-stream";
+    }
+};
+
+// Edge-triggered epoll reactor. The listening socket and every client socket
+// are non-blocking; each client is a small state machine that reads requests,
+// writes their responses as the socket allows and then either waits for the
+// next request (keep-alive) or closes. Pipelined requests that arrive together
+// are answered in order with one batched write.
+class EventLoop {
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    struct FileSend {
+        // Offset in the connection's out buffer where the body belongs
+        size_t out_position;
+        std::shared_ptr<FileCache::File> file;
+        off_t offset;
+        size_t remaining;
+    };
+    
+    // FIFO of pending file bodies. Unlike std::deque it keeps its storage
+    // when it drains, so steady-state traffic does not allocate.
+    class FileQueue {
+    public:
+        bool empty() const {
+            return head == items.size();
+        }
+        
+        size_t size() const {
+            return items.size() - head;
+        }
+        
+        FileSend& front() {
+            return items[head];
+        }
+        
+        FileSend& back() {
+            return items.back();
+        }
+        
+        void push_back(FileSend send) {
+            items.push_back(std::move(send));
+        }
+        
+        void pop_front() {
+            items[head].file.reset();
+            if (++head == items.size()) {
+                items.clear();
+                head = 0;
+            }
+        }
+        
+    private:
+        std::vector<FileSend> items;
+        size_t head = 0;
+    };
+    
+    struct Connection {
+        enum class State { Reading, Writing, Closing };
+        
+        explicit Connection(const ParserLimits& limits) : parser(limits) {}
+        
+        int fd = -1;
+        State state = State::Reading;
+        std::string in;
+        HttpParser parser;
+        HttpRequest request;
+        OutputBuffer out;
+        // File bodies to send with sendfile(), each at its position in out
+        FileQueue files;
+        Metrics::Tracker metrics;
+        // Peer address, looked up only when there is an access log
+        uint32_t client = 0;
+        // Request-scoped scratch memory, reset after every request
+        std::unique_ptr<Arena> arena;
+        unsigned requests_served = 0;
+        // Set once a response announced "Connection: close"
+        bool close_after_write = false;
+        // Fires at the deadline of whatever the connection waits for
+        TimerWheel::Timer timer;
+        // Tick of the last read or write progress
+        uint64_t active_tick = 0;
+        // Tick the pending request's header block, or its body, started
+        uint64_t phase_tick = 0;
+        bool reading_body = false;
+    };
+    
+    // Stop parsing pipelined requests while this much output is unsent
+    static constexpr size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+    static constexpr size_t MAX_PENDING_FILES = 64;
+    static constexpr size_t MAX_ACCEPTS_PER_WAKEUP = 64;
+    
+    const WebServer& server;
+    int listen_fd;
+    int epoll_fd;
+    // Set once a new process has taken over the listener
+    bool draining = false;
+    // Declared before the connections, whose timers it must outlive
+    TimerWheel timers;
+    std::unordered_map<int, Connection> connections;
+    ArenaPool arenas;
+    FileCache file_cache;
+    
+    static bool setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+    
+    void acceptConnections() {
+        // An own listener is edge-triggered and drained until accept()
+        // would block. A shared one is level-triggered, so a loop takes at
+        // most MAX_ACCEPTS_PER_WAKEUP and leaves the rest of a burst to the
+        // next loop the kernel wakes.
+        size_t limit = server.config.shared_listener ? MAX_ACCEPTS_PER_WAKEUP : SIZE_MAX;
+        size_t accepted = 0;
+        while (accepted < limit) {
+            int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::cerr << "Accept failed" << std::endl;
+                }
+                break;
+            }
+            ++accepted;
+            
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.fd = client_fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+                close(client_fd);
+                continue;
+            }
+            
+            Connection& conn = connections.emplace(client_fd, Connection(server.config.limits))
+                                          .first->second;
+            conn.fd = client_fd;
+            conn.arena = arenas.acquire();
+            conn.active_tick = timers.now();
+            armTimer(conn);
+            if (server.access_log) {
+                conn.client = WebServer::peerAddress(client_fd);
+            }
+        }
+        Metrics::countAccepts(accepted);
+    }
+    
+    // Answers every complete request buffered in conn.in, appending the
+    // responses to conn.out in request order.
+    void processRequests(Connection& conn) {
+        const ServerConfig& config = server.config;
+        size_t consumed = 0;
+        
+        while (!conn.close_after_write && conn.out.size() < MAX_PENDING_OUTPUT &&
+               conn.files.size() < MAX_PENDING_FILES) {
+            HttpRequest& request = conn.request;
+            uint64_t parse_start = Metrics::now();
+            HttpParser::Result result = conn.parser.parse(conn.in.data() + consumed,
+                                                          conn.in.size() - consumed, request,
+                                                          *conn.arena);
+            uint64_t handler_start = Metrics::now();
+            conn.metrics.parsed(parse_start, handler_start);
+            if (result == HttpParser::Result::Incomplete) {
+                if (conn.parser.readingBody() && !conn.reading_body) {
+                    conn.reading_body = true;
+                    conn.phase_tick = timers.now();
+                }
+                break;
+            }
+            size_t start = conn.out.size();
+            if (result == HttpParser::Result::Error) {
+                conn.out += server.createErrorResponse(conn.parser.errorStatus());
+                conn.metrics.responded(ROUTE_UNMATCHED, conn.parser.errorStatus(), handler_start);
+                if (server.access_log) {
+                    server.access_log->log(nullptr, conn.client, conn.parser.errorStatus(),
+                                           AccessLog::bodyBytes(conn.out, start));
+                }
+                conn.close_after_write = true;
+                break;
+            }
+            
+            ++conn.requests_served;
+            if (config.max_keep_alive_requests != 0 &&
+                conn.requests_served >= config.max_keep_alive_requests) {
+                request.keep_alive = false;
+            }
+            if (draining) {
+                request.keep_alive = false;
+            }
+            size_t route = server.routeRequest(request, conn.out, *conn.arena);
+            size_t queued_files = conn.files.size();
+            if (route == ROUTE_FILES) {
+                serveFile(conn, request);
+            }
+            int status = Metrics::statusAt(conn.out, start);
+            conn.metrics.responded(route, status, handler_start);
+            if (server.access_log) {
+                uint64_t bytes = AccessLog::bodyBytes(conn.out, start);
+                if (conn.files.size() > queued_files) {
+                    bytes += conn.files.back().remaining;
+                }
+                server.access_log->log(&request, conn.client, status, bytes);
+            }
+            if (!request.keep_alive) {
+                conn.close_after_write = true;
+            }
+            
+            consumed += request.length;
+            conn.parser.reset();
+            conn.arena->reset();
+            conn.reading_body = false;
+            conn.phase_tick = timers.now();
+        }
+        
+        conn.in.erase(0, consumed);
+        if (conn.out.sent() < conn.out.size() || !conn.files.empty()) {
+            conn.state = Connection::State::Writing;
+        }
+    }
+    
+    // Queues a document root file: the headers go into out and the body is
+    // sent from the page cache with sendfile() when the writer reaches it
+    void serveFile(Connection& conn, const HttpRequest& request) {
+        bool head = request.method == "HEAD";
+        if (request.method != "GET" && !head) {
+            conn.out += server.createErrorResponse(405, request.keep_alive, "Allow: GET, HEAD\r\n");
+            return;
+        }
+        
+        ArenaString path{ArenaAllocator<char>(*conn.arena)};
+        std::shared_ptr<FileCache::File> file;
+        int status = FileCache::normalizePath(request.target, path);
+        if (status == 0) {
+            file = file_cache.lookup(path, status);
+        }
+        if (!file) {
+            conn.out += server.createErrorResponse(status, request.keep_alive);
+            return;
+        }
+        
+        const ClockService::Snapshot& clock = ClockService::now();
+        bool not_modified = isNotModified(request, file->etag, file->mtime.tv_sec);
+        conn.out += not_modified ? "HTTP/1.1 304 Not Modified\r\n" : "HTTP/1.1 200 OK\r\n";
+        conn.out.append(clock.date_header, clock.date_header_length);
+        conn.out += "ETag: ";
+        conn.out += file->etag;
+        conn.out += "\r\nLast-Modified: ";
+        conn.out += file->last_modified;
+        conn.out += "\r\n";
+        const std::string& cache_control = server.config.file_cache_control;
+        if (!cache_control.empty()) {
+            conn.out += "Cache-Control: ";
+            conn.out += cache_control;
+            conn.out += "\r\n";
+        }
+        conn.out += request.keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+        if (not_modified) {
+            conn.out += "\r\n";
+            return;
+        }
+        conn.out += "Content-Type: ";
+        conn.out += file->content_type;
+        conn.out += "\r\nContent-Length: ";
+        appendDecimal(conn.out, file->size);
+        conn.out += "\r\n\r\n";
+        if (!head && file->size > 0) {
+            conn.files.push_back(FileSend{conn.out.size(), file, 0, file->size});
+        }
+    }
+    
+    void onReadable(Connection& conn) {
+        char buffer[BUFFER_SIZE * 16];
+        while (conn.state == Connection::State::Reading) {
+            ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                if (conn.in.empty()) {
+                    conn.phase_tick = timers.now();
+                }
+                conn.in.append(buffer, static_cast<size_t>(n));
+                conn.active_tick = timers.now();
+                processRequests(conn);
+            } else if (n == 0) {
+                conn.state = Connection::State::Closing;
+            } else if (errno == EINTR) {
+                continue;
+            } else {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    conn.state = Connection::State::Closing;
+                }
+                return;
+            }
+        }
+    }
+    
+    void onWritable(Connection& conn) {
+        while (conn.state == Connection::State::Writing) {
+            if (conn.out.sent() == conn.out.size() && conn.files.empty()) {
+                conn.metrics.drained();
+                conn.out.clear();
+                // While draining, a response that went out as keep-alive
+                // ends the connection unless a request is already buffered
+                if (conn.close_after_write || (draining && conn.in.empty())) {
+                    conn.state = Connection::State::Closing;
+                    return;
+                }
+                // Answer requests that were held back while output was
+                // pending, then pick up anything still unread in the socket
+                // (edge-triggered, so no new event will report it)
+                conn.state = Connection::State::Reading;
+                processRequests(conn);
+                if (conn.state == Connection::State::Reading) {
+                    onReadable(conn);
+                }
+                continue;
+            }
+            
+            ssize_t n;
+            if (!conn.files.empty() && conn.out.sent() == conn.files.front().out_position) {
+                FileSend& pending = conn.files.front();
+                n = sendfile(conn.fd, pending.file->fd, &pending.offset, pending.remaining);
+                if (n == 0) {
+                    // The file shrank after its Content-Length was sent
+                    conn.state = Connection::State::Closing;
+                    return;
+                }
+                if (n > 0) {
+                    pending.remaining -= static_cast<size_t>(n);
+                    if (pending.remaining == 0) {
+                        conn.files.pop_front();
+                    }
+                }
+            } else {
+                // Hold back the tail of a header block that precedes a file
+                // body so that headers and body share packets
+                size_t limit = conn.files.empty() ? conn.out.size() : conn.files.front().out_position;
+                struct iovec iov[MAX_IOVECS];
+                struct msghdr message = {};
+                message.msg_iov = iov;
+                message.msg_iovlen = conn.out.gather(iov, MAX_IOVECS, limit);
+                int flags = MSG_NOSIGNAL | (conn.files.empty() ? 0 : MSG_MORE);
+                n = sendmsg(conn.fd, &message, flags);
+                if (n > 0) {
+                    conn.out.consume(static_cast<size_t>(n));
+                }
+            }
+            
+            if (n >= 0) {
+                conn.active_tick = timers.now();
+                conn.metrics.wrote();
+            } else if (errno == EINTR) {
+                continue;
+            } else {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    conn.state = Connection::State::Closing;
+                }
+                return;
+            }
+        }
+    }
+    
+    void closeConnection(int fd) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        auto it = connections.find(fd);
+        if (it != connections.end()) {
+            arenas.release(std::move(it->second.arena));
+            connections.erase(it);
+        }
+    }
+    
+    // Tick by which the connection must make progress: the whole response
+    // must keep moving, a started request must arrive in full, and an idle
+    // connection may wait for the next one
+    uint64_t deadline(const Connection& conn) const {
+        const ServerConfig& config = server.config;
+        if (conn.state == Connection::State::Writing) {
+            return conn.active_tick + TimerWheel::ticks(config.write_timeout);
+        }
+        if (conn.in.empty()) {
+            return conn.active_tick + TimerWheel::ticks(config.keep_alive_timeout);
+        }
+        if (conn.reading_body) {
+            return conn.phase_tick + TimerWheel::ticks(config.body_timeout);
+        }
+        return conn.phase_tick + TimerWheel::ticks(config.header_timeout);
+    }
+    
+    // Called after every event. Activity only moves the deadline later, so
+    // the timer is left where it is and re-armed when it fires; it is moved
+    // only when the deadline becomes earlier.
+    void armTimer(Connection& conn) {
+        uint64_t due = deadline(conn);
+        if (!conn.timer.armed() || due < conn.timer.expiry()) {
+            timers.schedule(conn.timer, due, static_cast<uint64_t>(conn.fd));
+        }
+    }
+    
+    // Leaves new connections to the process that took over the listener
+    // and closes idle ones. The rest close once their current response is
+    // written (see onWritable()); responses begun from now on announce
+    // "Connection: close".
+    void startDraining() {
+        draining = true;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, server.drain_fd, nullptr);
+        std::vector<int> idle;
+        for (auto& entry : connections) {
+            if (entry.second.state == Connection::State::Reading && entry.second.in.empty()) {
+                idle.push_back(entry.first);
+            }
+        }
+        for (int fd : idle) {
+            closeConnection(fd);
+        }
+    }
+    
+    void onTimer(int fd) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) {
+            return;
+        }
+        uint64_t due = deadline(it->second);
+        if (due > timers.now()) {
+            timers.schedule(it->second.timer, due, static_cast<uint64_t>(fd));
+        } else {
+            closeConnection(fd);
+        }
+    }
+    
+public:
+    EventLoop(const WebServer& server, int listen_fd)
+        : server(server), listen_fd(listen_fd), epoll_fd(-1),
+          file_cache(server.config.document_root, server.config.file_cache_size) {}
+    
+    ~EventLoop() {
+        for (auto& entry : connections) {
+            close(entry.first);
+        }
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+    }
+    
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    
+    void run() {
+        if (!setNonBlocking(listen_fd)) {
+            throw std::runtime_error("Failed to make listening socket non-blocking");
+        }
+        
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            throw std::runtime_error("epoll_create1 failed");
+        }
+        
+        // EPOLLEXCLUSIVE wakes one of the loops waiting on a shared
+        // listener rather than all of them
+        epoll_event ev{};
+        ev.events = server.config.shared_listener ? EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN | EPOLLET;
+        ev.data.fd = listen_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+            throw std::runtime_error("epoll_ctl failed for listening socket");
+        }
+        ev.events = EPOLLIN;
+        ev.data.fd = server.drain_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server.drain_fd, &ev) < 0) {
+            throw std::runtime_error("epoll_ctl failed for the drain event");
+        }
+        
+        epoll_event events[MAX_EVENTS];
+        while (!draining || !connections.empty()) {
+            // Wake up for the next tick only while there are timers to run
+            int wait_ms = -1;
+            if (!connections.empty()) {
+                auto wait = timers.nextTick() - Clock::now();
+                wait_ms = static_cast<int>(
+                    std::chrono::ceil<std::chrono::milliseconds>(std::max(wait, Clock::duration::zero()))
+                        .count());
+            }
+            int count = epoll_wait(epoll_fd, events, MAX_EVENTS, wait_ms);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("epoll_wait failed");
+            }
+            // First, so that the events below read a current tick
+            timers.advance(Clock::now(), [this](uint64_t fd) { onTimer(static_cast<int>(fd)); });
+            
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == server.drain_fd) {
+                    startDraining();
+                    continue;
+                }
+                if (fd == listen_fd) {
+                    if (!draining) {
+                        acceptConnections();
+                    }
+                    continue;
+                }
+                
+                auto it = connections.find(fd);
+                if (it == connections.end()) {
+                    continue;
+                }
+                Connection& conn = it->second;
+                
+                uint32_t flags = events[i].events;
+                if (flags & EPOLLERR) {
+                    conn.state = Connection::State::Closing;
+                }
+                if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                    onReadable(conn);
+                }
+                // The response may be ready right after reading; try to flush
+                // it now rather than waiting for the next EPOLLOUT edge.
+                if (conn.state == Connection::State::Writing) {
+                    onWritable(conn);
+                }
+                if (conn.state == Connection::State::Closing) {
+                    closeConnection(fd);
+                } else {
+                    armTimer(conn);
+                }
+            }
+        }
+    }
+};
+
+#if XWEB_IO_URING
+// Thin io_uring wrapper over the raw system calls: the submission and
+// completion rings mapped into user space, plus one provided buffer ring
+// that the kernel picks receive buffers from. Only the owning thread may
+// use it.
+class IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params params{};
+        // Only this thread submits, and completion work runs when it waits
+        // (Linux 6.1+); retry without the hints on older kernels
+        params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0 && errno == EINVAL) {
+            params = io_uring_params{};
+            ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        }
+        if (ring_fd < 0) {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+        }
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            release();
+            throw std::runtime_error("kernel lacks IORING_FEAT_SINGLE_MMAP");
+        }
+        
+        size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring_size = std::max(sq_size, cq_size);
+        ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd, IORING_OFF_SQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqe_memory = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (ring == MAP_FAILED || sqe_memory == MAP_FAILED) {
+            if (sqe_memory != MAP_FAILED) {
+                munmap(sqe_memory, sqes_size);
+            }
+            release();
+            throw std::runtime_error("Mapping the io_uring rings failed");
+        }
+        sqes = static_cast<io_uring_sqe*>(sqe_memory);
+        
+        char* base = static_cast<char*>(ring);
+        sq_entries = params.sq_entries;
+        sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+        local_tail = *sq_tail;
+        submitted = local_tail;
+    }
+    
+    ~IoUring() {
+        release();
+    }
+    
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    
+    // Registers count buffers of size bytes as provided buffer group 0.
+    // count must be a power of two.
+    void registerBuffers(unsigned count, size_t size) {
+        buffer_ring_size = count * sizeof(io_uring_buf);
+        void* memory = mmap(nullptr, buffer_ring_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error("Allocating the io_uring buffer ring failed");
+        }
+        buffer_ring = static_cast<io_uring_buf_ring*>(memory);
+        
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(buffer_ring);
+        reg.ring_entries = count;
+        reg.bgid = 0;
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            throw std::runtime_error(std::string("Registering a provided buffer ring failed: ") +
+                                     std::strerror(errno));
+        }
+        
+        buffers.resize(count * size);
+        buffer_size = size;
+        buffer_mask = static_cast<uint16_t>(count - 1);
+        for (unsigned id = 0; id < count; ++id) {
+            recycleBuffer(static_cast<uint16_t>(id));
+        }
+    }
+    
+    const char* buffer(uint16_t id) const {
+        return buffers.data() + id * buffer_size;
+    }
+    
+    // Hands a buffer consumed from a completion back to the kernel
+    void recycleBuffer(uint16_t id) {
+        // Not buffer_ring->bufs: in C++ the header's flexible array member
+        // lands 8 bytes past the start of the ring
+        io_uring_buf& entry = reinterpret_cast<io_uring_buf*>(buffer_ring)[buffer_tail & buffer_mask];
+        entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+        entry.len = static_cast<uint32_t>(buffer_size);
+        entry.bid = id;
+        ++buffer_tail;
+        __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+    }
+    
+    // Makes room for count submissions in a row, so that linked entries
+    // are never split across two io_uring_enter() calls
+    void reserve(unsigned count) {
+        if (local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) + count > sq_entries) {
+            enter(0, 0);
+        }
+    }
+    
+    // Returns a zeroed submission entry, queued with the next enter
+    io_uring_sqe* getSqe() {
+        reserve(1);
+        unsigned index = local_tail & sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        ++local_tail;
+        return sqe;
+    }
+    
+    // Submits everything queued and waits for at least one completion
+    void submitAndWait() {
+        enter(1, IORING_ENTER_GETEVENTS);
+    }
+    
+    // Calls handler for every available completion, then releases them
+    template <typename Handler>
+    void forEachCompletion(Handler handler) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            handler(cqes[head & cq_mask]);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int ring_fd = -1;
+    void* ring = MAP_FAILED;
+    size_t ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned sq_entries = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    // Queued entries are published to the kernel on enter()
+    unsigned local_tail = 0;
+    unsigned submitted = 0;
+    io_uring_buf_ring* buffer_ring = nullptr;
+    size_t buffer_ring_size = 0;
+    std::vector<char> buffers;
+    size_t buffer_size = 0;
+    uint16_t buffer_mask = 0;
+    uint16_t buffer_tail = 0;
+    
+    void enter(unsigned min_complete, unsigned flags) {
+        __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+        int result = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, local_tail - submitted,
+                                              min_complete, flags, nullptr, 0));
+        if (result >= 0) {
+            submitted += static_cast<unsigned>(result);
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // EAGAIN/EBUSY mean the completion queue is backed up; the
+            // caller drains it and enters again
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+    }
+    
+    void release() {
+        if (buffer_ring != nullptr) {
+            munmap(buffer_ring, buffer_ring_size);
+        }
+        if (sqes != nullptr) {
+            munmap(sqes, sqes_size);
+        }
+        if (ring != MAP_FAILED) {
+            munmap(ring, ring_size);
+        }
+        if (ring_fd >= 0) {
+            close(ring_fd);
+        }
+    }
+};
+
+// io_uring counterpart of EventLoop for the built-in pages. One ring carries
+// every socket operation: a multishot accept on the listener, receives into
+// buffers the kernel takes from a provided buffer ring, sends, and a close
+// linked behind the last send of a connection. Each turn of the loop submits
+// everything queued while handling the previous completions and waits for
+// the next ones in a single io_uring_enter(), so a burst of short requests
+// costs one system call per batch instead of accept, recv, send and close
+// each. A connection has at most one receive or send in flight; like
+// EventLoop, it stops reading while a response is being written.
+class UringLoop {
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    enum class Op : uint8_t { Accept = 1, Recv, Send, Close, Timer, Cancel, Drain };
+    
+    struct Connection {
+        explicit Connection(const ParserLimits& limits) : parser(limits) {}
+        
+        int fd = -1;
+        std::string in;
+        HttpParser parser;
+        HttpRequest request;
+        // Owned by the kernel while a send is in flight, as are iov and
+        // message, which describe it
+        OutputBuffer out;
+        Metrics::Tracker metrics;
+        // Peer address, looked up only when there is an access log
+        uint32_t client = 0;
+        struct iovec iov[MAX_IOVECS];
+        struct msghdr message;
+        // Request-scoped scratch memory, reset after every request
+        std::unique_ptr<Arena> arena;
+        unsigned requests_served = 0;
+        // Set once a response announced "Connection: close"
+        bool close_after_write = false;
+        // A close is queued; no other operation will be submitted
+        bool closing = false;
+        // Fires at the deadline of whatever the connection waits for
+        TimerWheel::Timer timer;
+        // Tick of the last read or write progress
+        uint64_t active_tick = 0;
+        // Tick the pending request's header block, or its body, started
+        uint64_t phase_tick = 0;
+        bool reading_body = false;
+    };
+    
+    static constexpr unsigned RING_ENTRIES = 1024;
+    static constexpr unsigned BUFFER_COUNT = 256;
+    static constexpr size_t RECV_BUFFER_SIZE = BUFFER_SIZE * 16;
+    // Stop parsing pipelined requests while this much output is unsent
+    static constexpr size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+    
+    const WebServer& server;
+    int listen_fd;
+    IoUring ring;
+    // Declared before the connections, whose timers it must outlive
+    TimerWheel timers;
+    // Keyed by an id rather than the fd: completions for a closed socket
+    // must not reach a new connection that reused its descriptor
+    std::unordered_map<uint32_t, Connection> connections;
+    ArenaPool arenas;
+    uint32_t next_id = 0;
+    // Set once a new process has taken over the listener
+    bool draining = false;
+    // Whether a timeout is in flight; it is only kept armed while the wheel
+    // holds timers, so an idle loop sleeps until the next completion
+    bool ticking = false;
+    __kernel_timespec tick_interval = {
+        0, std::chrono::duration_cast<std::chrono::nanoseconds>(TimerWheel::TICK).count()};
+    
+    static uint64_t userData(Op op, uint32_t id) {
+        return (static_cast<uint64_t>(op) << 32) | id;
+    }
+    
+    void submitAccept() {
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = userData(Op::Accept, 0);
+    }
+    
+    void submitTimer() {
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<uint64_t>(&tick_interval);
+        sqe->len = 1;
+        sqe->user_data = userData(Op::Timer, 0);
+    }
+    
+    void submitDrainWatch() {
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = server.drain_fd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = userData(Op::Drain, 0);
+    }
+    
+    void submitRecv(uint32_t id, Connection& conn) {
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn.fd;
+        sqe->len = static_cast<uint32_t>(RECV_BUFFER_SIZE);
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->user_data = userData(Op::Recv, id);
+    }
+    
+    void submitSend(uint32_t id, Connection& conn) {
+        ring.reserve(2);
+        conn.message = {};
+        conn.message.msg_iov = conn.iov;
+        conn.message.msg_iovlen = conn.out.gather(conn.iov, MAX_IOVECS, conn.out.size());
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&conn.message);
+        sqe->len = 1;
+        // MSG_WAITALL makes the kernel finish the send across partial
+        // writes, and fails the link if it cannot
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = userData(Op::Send, id);
+        // With more segments than fit in iov, the close waits for the
+        // last send
+        if (conn.close_after_write && conn.message.msg_iovlen < MAX_IOVECS) {
+            sqe->flags = IOSQE_IO_LINK;
+            submitClose(id, conn);
+        }
+    }
+    
+    // Cancels the connection's pending receive or send by its user data,
+    // which, unlike its descriptor, is never reused by another connection.
+    // The failed operation then closes the connection.
+    void submitCancel(uint32_t id, const Connection& conn) {
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = userData(conn.out.sent() < conn.out.size() ? Op::Send : Op::Recv, id);
+        sqe->user_data = userData(Op::Cancel, id);
+    }
+    
+    void submitClose(uint32_t id, Connection& conn) {
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = conn.fd;
+        sqe->user_data = userData(Op::Close, id);
+        conn.closing = true;
+    }
+    
+    // Answers every complete request buffered in conn.in, appending the
+    // responses to conn.out in request order
+    void processRequests(Connection& conn) {
+        const ServerConfig& config = server.config;
+        size_t consumed = 0;
+        
+        while (!conn.close_after_write && conn.out.size() < MAX_PENDING_OUTPUT) {
+            HttpRequest& request = conn.request;
+            uint64_t parse_start = Metrics::now();
+            HttpParser::Result result = conn.parser.parse(conn.in.data() + consumed,
+                                                          conn.in.size() - consumed, request,
+                                                          *conn.arena);
+            uint64_t handler_start = Metrics::now();
+            conn.metrics.parsed(parse_start, handler_start);
+            if (result == HttpParser::Result::Incomplete) {
+                if (conn.parser.readingBody() && !conn.reading_body) {
+                    conn.reading_body = true;
+                    conn.phase_tick = timers.now();
+                }
+                break;
+            }
+            size_t start = conn.out.size();
+            if (result == HttpParser::Result::Error) {
+                conn.out += server.createErrorResponse(conn.parser.errorStatus());
+                conn.metrics.responded(ROUTE_UNMATCHED, conn.parser.errorStatus(), handler_start);
+                if (server.access_log) {
+                    server.access_log->log(nullptr, conn.client, conn.parser.errorStatus(),
+                                           AccessLog::bodyBytes(conn.out, start));
+                }
+                conn.close_after_write = true;
+                break;
+            }
+            
+            ++conn.requests_served;
+            if (config.max_keep_alive_requests != 0 &&
+                conn.requests_served >= config.max_keep_alive_requests) {
+                request.keep_alive = false;
+            }
+            if (draining) {
+                request.keep_alive = false;
+            }
+            size_t route = server.routeRequest(request, conn.out, *conn.arena);
+            int status = Metrics::statusAt(conn.out, start);
+            conn.metrics.responded(route, status, handler_start);
+            if (server.access_log) {
+                server.access_log->log(&request, conn.client, status,
+                                       AccessLog::bodyBytes(conn.out, start));
+            }
+            if (!request.keep_alive) {
+                conn.close_after_write = true;
+            }
+            
+            consumed += request.length;
+            conn.parser.reset();
+            conn.arena->reset();
+            conn.reading_body = false;
+            conn.phase_tick = timers.now();
+        }
+        
+        conn.in.erase(0, consumed);
+    }
+    
+    // Sends pending output, or goes back to reading when there is none
+    void resume(uint32_t id, Connection& conn) {
+        processRequests(conn);
+        if (!conn.out.empty()) {
+            submitSend(id, conn);
+        } else {
+            submitRecv(id, conn);
+        }
+    }
+    
+    void onAccept(const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE) && !draining) {
+            submitAccept();
+        }
+        if (cqe.res < 0) {
+            if (cqe.res != -EINTR && cqe.res != -ECONNABORTED && cqe.res != -EAGAIN &&
+                cqe.res != -ECANCELED) {
+                std::cerr << "Accept failed" << std::endl;
+            }
+            return;
+        }
+        
+        while (connections.count(next_id) != 0) {
+            ++next_id;
+        }
+        uint32_t id = next_id++;
+        Connection& conn = connections.emplace(id, Connection(server.config.limits)).first->second;
+        conn.fd = cqe.res;
+        conn.arena = arenas.acquire();
+        conn.active_tick = timers.now();
+        if (server.access_log) {
+            conn.client = WebServer::peerAddress(conn.fd);
+        }
+        submitRecv(id, conn);
+        armTimer(id, conn);
+    }
+    
+    void onRecv(uint32_t id, Connection& conn, const io_uring_cqe& cqe) {
+        if (cqe.res == -ENOBUFS) {
+            // Every buffer is in use; they come back as this batch is
+            // handled
+            submitRecv(id, conn);
+            return;
+        }
+        if (cqe.res <= 0) {
+            submitClose(id, conn);
+            return;
+        }
+        
+        uint16_t buffer_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (conn.in.empty()) {
+            conn.phase_tick = timers.now();
+        }
+        conn.in.append(ring.buffer(buffer_id), static_cast<size_t>(cqe.res));
+        ring.recycleBuffer(buffer_id);
+        conn.active_tick = timers.now();
+        resume(id, conn);
+    }
+    
+    void onSend(uint32_t id, Connection& conn, const io_uring_cqe& cqe) {
+        if (conn.closing) {
+            // The linked close completes (or is cancelled) next
+            if (cqe.res > 0) {
+                conn.metrics.wrote();
+                conn.metrics.drained();
+            }
+            return;
+        }
+        if (cqe.res < 0) {
+            submitClose(id, conn);
+            return;
+        }
+        
+        conn.out.consume(static_cast<size_t>(cqe.res));
+        conn.active_tick = timers.now();
+        conn.metrics.wrote();
+        if (conn.out.sent() < conn.out.size()) {
+            submitSend(id, conn);
+            return;
+        }
+        conn.metrics.drained();
+        conn.out.clear();
+        // As in EventLoop::onWritable(), draining ends a keep-alive
+        // connection with nothing more buffered
+        if (conn.close_after_write || (draining && conn.in.empty())) {
+            submitClose(id, conn);
+            return;
+        }
+        // Answer requests that were held back while output was pending
+        resume(id, conn);
+    }
+    
+    void onClose(uint32_t id, Connection& conn, const io_uring_cqe& cqe) {
+        // A close linked behind a failed send is cancelled with it
+        if (cqe.res == -ECANCELED) {
+            close(conn.fd);
+        }
+        arenas.release(std::move(conn.arena));
+        connections.erase(id);
+    }
+    
+    // Same deadlines as EventLoop::deadline(); a send is in flight exactly
+    // while out has unsent bytes
+    uint64_t deadline(const Connection& conn) const {
+        const ServerConfig& config = server.config;
+        if (conn.out.sent() < conn.out.size()) {
+            return conn.active_tick + TimerWheel::ticks(config.write_timeout);
+        }
+        if (conn.in.empty()) {
+            return conn.active_tick + TimerWheel::ticks(config.keep_alive_timeout);
+        }
+        if (conn.reading_body) {
+            return conn.phase_tick + TimerWheel::ticks(config.body_timeout);
+        }
+        return conn.phase_tick + TimerWheel::ticks(config.header_timeout);
+    }
+    
+    // Moves the timer only when the deadline became earlier; later ones are
+    // picked up when it fires
+    void armTimer(uint32_t id, Connection& conn) {
+        uint64_t due = deadline(conn);
+        if (!conn.timer.armed() || due < conn.timer.expiry()) {
+            timers.schedule(conn.timer, due, id);
+        }
+        if (!ticking) {
+            submitTimer();
+            ticking = true;
+        }
+    }
+    
+    void onTimer() {
+        timers.advance(Clock::now(), [this](uint64_t key) {
+            uint32_t id = static_cast<uint32_t>(key);
+            auto it = connections.find(id);
+            if (it == connections.end()) {
+                return;
+            }
+            uint64_t due = deadline(it->second);
+            if (due > timers.now()) {
+                timers.schedule(it->second.timer, due, id);
+            } else {
+                submitCancel(id, it->second);
+            }
+        });
+        ticking = !timers.empty();
+        if (ticking) {
+            submitTimer();
+        }
+    }
+    
+    // Same as EventLoop::startDraining(): the multishot accept is
+    // cancelled, and so are the receives of idle connections, which then
+    // close. Connections with a send in flight close when it completes
+    // (see onSend()).
+    void startDraining() {
+        draining = true;
+        io_uring_sqe* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = userData(Op::Accept, 0);
+        sqe->user_data = userData(Op::Cancel, 0);
+        for (auto& entry : connections) {
+            Connection& conn = entry.second;
+            if (!conn.closing && conn.in.empty() && conn.out.empty()) {
+                submitCancel(entry.first, conn);
+            }
+        }
+    }
+    
+    void onCompletion(const io_uring_cqe& cqe) {
+        Op op = static_cast<Op>(cqe.user_data >> 32);
+        uint32_t id = static_cast<uint32_t>(cqe.user_data);
+        if (!ticking) {
+            // The wheel stood still while the loop slept; catch it up
+            // before connections stamp their ticks from it
+            timers.advance(Clock::now(), [](uint64_t) {});
+        }
+        if (op == Op::Accept) {
+            onAccept(cqe);
+            return;
+        }
+        if (op == Op::Drain) {
+            startDraining();
+            return;
+        }
+        if (op == Op::Timer) {
+            onTimer();
+            return;
+        }
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        switch (op) {
+            case Op::Recv:
+                onRecv(id, it->second, cqe);
+                armTimer(id, it->second);
+                break;
+            case Op::Send:
+                onSend(id, it->second, cqe);
+                armTimer(id, it->second);
+                break;
+            case Op::Close:
+                onClose(id, it->second, cqe);
+                break;
+            default:
+                break;
+        }
+    }
+
+public:
+    UringLoop(const WebServer& server, int listen_fd)
+        : server(server), listen_fd(listen_fd), ring(RING_ENTRIES) {
+        ring.registerBuffers(BUFFER_COUNT, RECV_BUFFER_SIZE);
+    }
+    
+    ~UringLoop() {
+        for (auto& entry : connections) {
+            close(entry.second.fd);
+        }
+    }
+    
+    UringLoop(const UringLoop&) = delete;
+    UringLoop& operator=(const UringLoop&) = delete;
+    
+    // Checks that the kernel offers everything the loop relies on. Provided
+    // buffer rings and multishot accept both arrived in Linux 5.19.
+    static bool supported(std::string& reason) {
+        try {
+            IoUring probe(8);
+            probe.registerBuffers(1, 1);
+            return true;
+        } catch (const std::exception& e) {
+            reason = e.what();
+            return false;
+        }
+    }
+    
+    void run() {
+        submitAccept();
+        submitDrainWatch();
+        while (!draining || !connections.empty()) {
+            ring.submitAndWait();
+            ring.forEachCompletion([this](const io_uring_cqe& cqe) { onCompletion(cqe); });
+        }
+    }
+};
+#endif
+#endif
+
+#ifdef __linux__
+void WebServer::runLoop(int fd, unsigned worker) const {
+    // Before the loop allocates anything, so its memory is node-local
+    pinWorker(worker);
+#if XWEB_IO_URING
+    if (config.io_backend == ServerConfig::IoBackend::IoUring) {
+        UringLoop loop(*this, fd);
+        loop.run();
+        return;
+    }
+#endif
+    EventLoop loop(*this, fd);
+    loop.run();
+}
+#endif
+
+void WebServer::run() {
+#ifdef __linux__
+    // SIGUSR2 is blocked in every thread since the constructor; this one
+    // waits for it in sigwait()
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR2);
+    drain_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (drain_fd < 0) {
+        throw std::runtime_error("eventfd failed");
+    }
+    std::atomic<bool> done{false};
+    std::thread upgrades([this, &signals, &done]() { awaitUpgrade(signals, done); });
+    auto stopUpgrades = [&]() {
+        done.store(true);
+        pthread_kill(upgrades.native_handle(), SIGUSR2);
+        upgrades.join();
+    };
+    try {
+        serve();
+    } catch (...) {
+        stopUpgrades();
+        throw;
+    }
+    stopUpgrades();
+#else
+    serve();
+#endif
+}
+
+void WebServer::serve() {
+    if (config.pool_threads > 0) {
+        WorkerPool pool(*this, server_fd);
+        pool.run();
+        return;
+    }
+    
+#ifdef __linux__
+    if (config.io_backend == ServerConfig::IoBackend::IoUring) {
+#if XWEB_IO_URING
+        std::string reason;
+        bool available = UringLoop::supported(reason);
+#else
+        std::string reason = "not compiled in";
+        bool available = false;
+#endif
+        if (available) {
+            std::cout << "Using the io_uring backend" << std::endl;
+        } else {
+            std::cerr << "io_uring unavailable (" << reason << "), using epoll" << std::endl;
+            config.io_backend = ServerConfig::IoBackend::Epoll;
+        }
+    }
+    
+    // Each worker runs an independent event loop, on its own listener or on
+    // the shared one, so there is no accept lock or cross-thread state
+    if (config.workers == 1) {
+        runLoop(server_fd, 0);
+        return;
+    }
+    
+    std::vector<int> loop_fds = listen_fds;
+    loop_fds.resize(config.workers, server_fd);
+    std::vector<std::thread> threads;
+    for (unsigned worker = 0; worker < loop_fds.size(); ++worker) {
+        int fd = loop_fds[worker];
+        threads.emplace_back([this, fd, worker]() {
+            try {
+                runLoop(fd, worker);
+            } catch (const std::exception& e) {
+                std::cerr << "Worker error: " << e.what() << std::endl;
+            }
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+#else
+    runBlocking();
+#endif
+}
+
+// Appends the options in a configuration file to args. Each line holds an
+// option name without the leading dashes and its value, if it takes one:
+//
+//     # comment
+//     workers 8
+//     shared-listener
+//     cache-control api=max-age=60, public
+void readConfigFile(const std::string& path, std::vector<std::string>& args) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open config file " + path);
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string_view text = trimWhitespace(line);
+        if (text.empty() || text.front() == '#') {
+            continue;
+        }
+        size_t space = text.find_first_of(" \t");
+        args.push_back("--" + std::string(text.substr(0, space)));
+        if (space != std::string_view::npos) {
+            args.emplace_back(trimWhitespace(text.substr(space)));
+        }
+    }
+}
+
+ServerConfig parseArguments(int argc, char* argv[]) {
+    // Options from --config files take effect where the file is named, so
+    // later command line options override them
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--config" && i + 1 < argc) {
+            readConfigFile(argv[++i], args);
+        } else {
+            args.emplace_back(argv[i]);
+        }
+    }
+    
+    ServerConfig config;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (arg == "--workers" && i + 1 < args.size()) {
+            config.workers = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg == "--keepalive-timeout" && i + 1 < args.size()) {
+            config.keep_alive_timeout = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg == "--header-timeout" && i + 1 < args.size()) {
+            config.header_timeout = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg == "--body-timeout" && i + 1 < args.size()) {
+            config.body_timeout = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg == "--write-timeout" && i + 1 < args.size()) {
+            config.write_timeout = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg == "--max-requests" && i + 1 < args.size()) {
+            config.max_keep_alive_requests = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg == "--max-header-size" && i + 1 < args.size()) {
+            config.limits.max_header_bytes = std::stoul(args[++i]);
+            config.limits.max_request_line = config.limits.max_header_bytes;
+        } else if (arg == "--max-headers" && i + 1 < args.size()) {
+            config.limits.max_headers = std::stoul(args[++i]);
+        } else if (arg == "--max-body-size" && i + 1 < args.size()) {
+            config.limits.max_body = std::stoul(args[++i]);
+        } else if (arg == "--root" && i + 1 < args.size()) {
+            config.document_root = args[++i];
+        } else if (arg == "--file-cache-size" && i + 1 < args.size()) {
+            config.file_cache_size = std::max<size_t>(1, std::stoul(args[++i]));
+        } else if (arg == "--io-backend" && i + 1 < args.size()) {
+            std::string backend = args[++i];
+            if (backend == "epoll") {
+                config.io_backend = ServerConfig::IoBackend::Epoll;
+            } else if (backend == "io_uring") {
+                config.io_backend = ServerConfig::IoBackend::IoUring;
+            } else {
+                throw std::invalid_argument("Unknown I/O backend: " + backend);
+            }
+        } else if (arg == "--backlog" && i + 1 < args.size()) {
+            config.listen_backlog = std::stoi(args[++i]);
+        } else if (arg == "--cpu-affinity" && i + 1 < args.size()) {
+            config.cpu_affinity = args[++i];
+        } else if (arg == "--shared-listener") {
+            config.shared_listener = true;
+        } else if (arg == "--tcp-nodelay" && i + 1 < args.size()) {
+            std::string value = args[++i];
+            if (value != "on" && value != "off") {
+                throw std::invalid_argument("Expected on or off: " + value);
+            }
+            config.socket_options.tcp_nodelay = value == "on";
+        } else if (arg == "--defer-accept" && i + 1 < args.size()) {
+            config.socket_options.defer_accept = std::stoi(args[++i]);
+        } else if (arg == "--fastopen" && i + 1 < args.size()) {
+            config.socket_options.fastopen_queue = std::stoi(args[++i]);
+        } else if (arg == "--send-buffer" && i + 1 < args.size()) {
+            config.socket_options.send_buffer = std::stoi(args[++i]);
+        } else if (arg == "--receive-buffer" && i + 1 < args.size()) {
+            config.socket_options.receive_buffer = std::stoi(args[++i]);
+        } else if (arg == "--notsent-lowat" && i + 1 < args.size()) {
+            config.socket_options.notsent_lowat = std::stoi(args[++i]);
+        } else if (arg == "--busy-poll" && i + 1 < args.size()) {
+            config.socket_options.busy_poll = std::stoi(args[++i]);
+        } else if (arg == "--pool-threads" && i + 1 < args.size()) {
+            config.pool_threads = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg == "--pool-queue" && i + 1 < args.size()) {
+            config.pool_queue_depth = std::max<size_t>(1, std::stoul(args[++i]));
+        } else if (arg == "--pool-overflow" && i + 1 < args.size()) {
+            std::string policy = args[++i];
+            if (policy == "reject") {
+                config.pool_overflow = ServerConfig::Overflow::Reject;
+            } else if (policy == "block") {
+                config.pool_overflow = ServerConfig::Overflow::Block;
+            } else {
+                throw std::invalid_argument("Unknown overflow policy: " + policy);
+            }
+        } else if (arg == "--cache-control" && i + 1 < args.size()) {
+            // ROUTE=VALUE, ROUTE being page, api or files
+            std::string policy = args[++i];
+            size_t equals = policy.find('=');
+            std::string route = policy.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : policy.substr(equals + 1);
+            if (equals == std::string::npos) {
+                throw std::invalid_argument("Expected ROUTE=VALUE: " + policy);
+            } else if (route == "page") {
+                config.page_cache_control = value;
+            } else if (route == "api") {
+                config.api_cache_control = value;
+            } else if (route == "files") {
+                config.file_cache_control = value;
+            } else {
+                throw std::invalid_argument("Unknown cache route: " + route);
+            }
+        } else if (arg == "--access-log" && i + 1 < args.size()) {
+            config.access_log_path = args[++i];
+        } else if (arg == "--access-log-format" && i + 1 < args.size()) {
+            std::string format = args[++i];
+            if (format == "common") {
+                config.access_log_format = ServerConfig::LogFormat::Common;
+            } else if (format == "combined") {
+                config.access_log_format = ServerConfig::LogFormat::Combined;
+            } else if (format == "json") {
+                config.access_log_format = ServerConfig::LogFormat::Json;
+            } else {
+                throw std::invalid_argument("Unknown access log format: " + format);
+            }
+        } else if (arg == "--access-log-buffer" && i + 1 < args.size()) {
+            config.access_log_buffer = std::max<size_t>(1, std::stoul(args[++i]));
+        } else if (arg == "--access-log-rotate" && i + 1 < args.size()) {
+            config.access_log_rotate_size = std::stoull(args[++i]);
+        } else {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
+    }
+    return config;
+}
+
+#ifdef XWEB_COUNT_ALLOCATIONS
+// Heap allocations made by the current thread, for `--bench alloc`
+thread_local uint64_t allocation_count = 0;
+
+void* operator new(std::size_t size) {
+    ++allocation_count;
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+// Not inlined: GCC would otherwise flag free() as mismatched with new
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+#endif
+
+// Micro-benchmarks, run with `webserver --bench <name>`
+namespace bench {
+
+// Parses raw as one request and routes it as the event loops do, returning
+// the route index; the response is appended to out
+int routeRaw(const WebServer& server, std::string_view raw, OutputBuffer& out) {
+    HttpParser parser(server.config.limits);
+    HttpRequest request;
+    Arena arena;
+    if (parser.parse(raw.data(), raw.size(), request, arena) != HttpParser::Result::Complete) {
+        throw std::runtime_error("benchmark request failed to parse");
+    }
+    return static_cast<int>(server.routeRequest(request, out, arena));
+}
+
+// Timestamp counter on x86, nanoseconds elsewhere
+uint64_t ticks() {
+#if XWEB_X86_SIMD
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+const char* tickUnit() {
+    return XWEB_X86_SIMD ? "cycle" : "ns";
+}
+
+// Request heads as sent by current browsers when loading the HTML page
+const char* const BROWSER_REQUESTS[][2] = {
+    {"chrome",
+     "GET / HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "Connection: keep-alive\r\n"
+     "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+     "sec-ch-ua-mobile: ?0\r\n"
+     "sec-ch-ua-platform: \"Linux\"\r\n"
+     "Upgrade-Insecure-Requests: 1\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+     "Chrome/124.0.0.0 Safari/537.36\r\n"
+     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+     "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+     "Sec-Fetch-Site: none\r\n"
+     "Sec-Fetch-Mode: navigate\r\n"
+     "Sec-Fetch-User: ?1\r\n"
+     "Sec-Fetch-Dest: document\r\n"
+     "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+     "Accept-Language: en-US,en;q=0.9,fr;q=0.8\r\n"
+     "\r\n"},
+    {"firefox",
+     "GET / HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+     "Accept-Language: en-US,en;q=0.5\r\n"
+     "Accept-Encoding: gzip, deflate, br\r\n"
+     "Connection: keep-alive\r\n"
+     "Upgrade-Insecure-Requests: 1\r\n"
+     "Sec-Fetch-Dest: document\r\n"
+     "Sec-Fetch-Mode: navigate\r\n"
+     "Sec-Fetch-Site: none\r\n"
+     "Sec-Fetch-User: ?1\r\n"
+     "Priority: u=1\r\n"
+     "\r\n"},
+};
+
+// Header scanning kernels and the full parser on realistic browser requests,
+// for every instruction set this CPU supports
+void runScan() {
+    constexpr int ITERATIONS = 200000;
+    ParserLimits limits;
+    const HeaderScanner::Isa isas[] = {HeaderScanner::Isa::Scalar, HeaderScanner::Isa::Sse42,
+                                       HeaderScanner::Isa::Avx2};
+    
+    for (const auto& sample : BROWSER_REQUESTS) {
+        std::string request = sample[1];
+        const char* begin = request.data();
+        const char* end = begin + request.size();
+        std::cout << sample[0] << " (" << request.size() << " bytes)" << std::endl;
+        
+        std::vector<size_t> line_starts;
+        for (size_t offset = request.find("\r\n") + 2; offset + 2 < request.size();
+             offset = request.find("\r\n", offset) + 2) {
+            line_starts.push_back(offset);
+        }
+        
+        double scalar_parse = 0;
+        for (HeaderScanner::Isa isa : isas) {
+            if (!HeaderScanner::supported(isa)) {
+                continue;
+            }
+            const HeaderScanner scanner = HeaderScanner::forIsa(isa);
+            
+            // Line-by-line delimiter scan, as the parser does it
+            size_t scanned = 0;
+            uint64_t start = ticks();
+            for (int i = 0; i < ITERATIONS; ++i) {
+                const char* p = begin;
+                while (p < end) {
+                    const char* stop = scanner.findDelimiter(p, end);
+                    scanned += static_cast<size_t>(stop - p) + 2;
+                    p = stop + 2;
+                }
+            }
+            double delimiter_ticks = static_cast<double>(ticks() - start);
+            
+            // Header names, scanned from the start of each line
+            size_t tokens = 0;
+            start = ticks();
+            for (int i = 0; i < ITERATIONS; ++i) {
+                for (size_t offset : line_starts) {
+                    tokens += static_cast<size_t>(scanner.scanToken(begin + offset, end) -
+                                                  (begin + offset));
+                }
+            }
+            double token_ticks = static_cast<double>(ticks() - start);
+            
+            HttpParser parser(limits, scanner);
+            HttpRequest parsed;
+            Arena arena;
+            start = ticks();
+            for (int i = 0; i < ITERATIONS; ++i) {
+                parser.reset();
+                arena.reset();
+                if (parser.parse(begin, request.size(), parsed, arena) != HttpParser::Result::Complete) {
+                    throw std::runtime_error("benchmark request failed to parse");
+                }
+            }
+            double parse_ticks = static_cast<double>(ticks() - start);
+            if (isa == HeaderScanner::Isa::Scalar) {
+                scalar_parse = parse_ticks;
+            }
+            
+            std::cout << "  " << std::left << std::setw(8) << HeaderScanner::name(isa)
+                      << std::fixed << std::setprecision(2)
+                      << " delimiters " << scanned / delimiter_ticks << " B/" << tickUnit()
+                      << "  tokens " << tokens / token_ticks << " B/" << tickUnit()
+                      << "  parse " << request.size() * ITERATIONS / parse_ticks << " B/" << tickUnit()
+                      << " (" << parse_ticks / ITERATIONS << " " << tickUnit() << "s/request, "
+                      << scalar_parse / parse_ticks << "x scalar)" << std::endl;
+        }
+    }
+}
+
+// Heap allocations per request on the steady-state keep-alive path: parse,
+// route and append the response, then reset the arena. Fails if any request
+// allocates once the buffers have warmed up.
+int runAllocations() {
+#ifdef XWEB_COUNT_ALLOCATIONS
+    constexpr int WARMUP = 100;
+    constexpr int ITERATIONS = 100000;
+    WebServer server;
+    int failures = 0;
+    
+    for (const char* target : {"/", "/api"}) {
+        std::string request = std::string("GET ") + target + " HTTP/1.1\r\n" +
+                              "Host: localhost:8080\r\n"
+                              "User-Agent: xweb-bench\r\n"
+                              "Accept: */*\r\n"
+                              "\r\n";
+        HttpParser parser(server.config.limits);
+        HttpRequest parsed;
+        Arena arena;
+        OutputBuffer out;
+        uint64_t allocations = 0;
+        
+        for (int i = 0; i < WARMUP + ITERATIONS; ++i) {
+            if (i == WARMUP) {
+                allocations = allocation_count;
+            }
+            parser.reset();
+            if (parser.parse(request.data(), request.size(), parsed, arena) !=
+                HttpParser::Result::Complete) {
+                throw std::runtime_error("benchmark request failed to parse");
+            }
+            server.routeRequest(parsed, out, arena);
+            out.clear();
+            arena.reset();
+        }
+        allocations = allocation_count - allocations;
+        
+        std::cout << std::left << std::setw(6) << target << " "
+                  << static_cast<double>(allocations) / ITERATIONS << " allocations/request" << std::endl;
+        if (allocations != 0) {
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+#else
+    std::cerr << "Allocation counting is not compiled in; rebuild with -DXWEB_COUNT_ALLOCATIONS" << std::endl;
+    return 1;
+#endif
+}
+
+// Radix router lookups with 1,000 patterns registered: static paths,
+// one and two parameters, and wildcards. Fails above 100 ns per lookup.
+int runRouter() {
+    constexpr int ROUTES = 1000;
+    constexpr int ITERATIONS = 2000;
+    constexpr double TARGET_NS = 100;
+    RadixRouter router;
+    RouteFunction handler = [](const HttpRequest&, const RouteParams&, OutputBuffer&, Arena&) {};
+    std::vector<std::string> paths;
+    for (int i = 0; i < ROUTES / 4; ++i) {
+        std::string n = std::to_string(i);
+        router.add(METHOD_GET, "/static/page" + n, handler);
+        router.add(METHOD_GET, "/api/v1/resource" + n + "/{id}", handler);
+        router.add(METHOD_GET | METHOD_POST, "/api/v1/resource" + n + "/{id}/items/{item}", handler);
+        router.add(METHOD_GET, "/files" + n + "/*path", handler);
+        paths.push_back("/static/page" + n);
+        paths.push_back("/api/v1/resource" + n + "/12345");
+        paths.push_back("/api/v1/resource" + n + "/42/items/abc");
+        paths.push_back("/files" + n + "/css/site.css");
+    }
+    // Visit paths in a scattered order so consecutive lookups share little
+    std::vector<std::string_view> order;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        order.push_back(paths[(i * 7919) % paths.size()]);
+    }
+    
+    RouteParams params;
+    unsigned allowed = 0;
+    size_t matched = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        for (std::string_view path : order) {
+            matched += router.find(path, METHOD_GET, params, allowed) != nullptr;
+        }
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+    double per_lookup = elapsed / (static_cast<double>(ITERATIONS) * order.size());
+    
+    std::cout << ROUTES << " routes: " << std::fixed << std::setprecision(1) << per_lookup
+              << " ns/lookup (target < " << TARGET_NS << ")" << std::endl;
+    if (matched != ITERATIONS * order.size()) {
+        std::cerr << "Router missed " << ITERATIONS * order.size() - matched << " lookups" << std::endl;
+        return 1;
+    }
+    
+    // An application registers routes through the public API only (this
+    // function is no friend of WebServer); a request must then reach them
+    // through the server's own routing
+    WebServer server;
+    server.addRoute(METHOD_GET, "/items/{id}",
+                    [](const HttpRequest& request, const RouteParams& params, OutputBuffer& out, Arena&) {
+                        WebServer::appendResponse(out, request, 200, "text/plain", params.get("id"));
+                    });
+    // Overlaps /items/{id}: a method only the parameter route accepts must
+    // backtrack to it rather than get 405 from the static one
+    server.addRoute(METHOD_POST, "/items/new",
+                    [](const HttpRequest& request, const RouteParams&, OutputBuffer& out, Arena&) {
+                        WebServer::appendResponse(out, request, 201, "text/plain", "created");
+                    });
+    struct Case {
+        const char* request;
+        int status;
+        // Expected at the end of the response, or in its head for errors
+        const char* text;
+    };
+    const Case cases[] = {
+        {"GET /items/42 HTTP/1.1\r\n", 200, "42"},
+        {"GET /items/new HTTP/1.1\r\n", 200, "new"},
+        {"POST /items/new HTTP/1.1\r\nContent-Length: 0\r\n", 201, "created"},
+        {"PUT /items/42 HTTP/1.1\r\nContent-Length: 0\r\n", 405, "Allow: GET\r\n"},
+        {"PUT /items/new HTTP/1.1\r\nContent-Length: 0\r\n", 405, "Allow: GET, POST\r\n"},
+    };
+    int failures = 0;
+    for (const Case& test : cases) {
+        OutputBuffer out;
+        routeRaw(server, std::string(test.request) + "Host: localhost\r\n\r\n", out);
+        std::string_view response = out.peek(0, out.size());
+        std::string_view text = test.text;
+        bool found = test.status >= 400 ? response.find(text) != std::string_view::npos
+                                        : response.size() >= text.size() &&
+                                              response.substr(response.size() - text.size()) == text;
+        if (Metrics::statusAt(out, 0) != test.status || !found) {
+            std::string_view line(test.request);
+            std::cerr << "Wrong response to " << line.substr(0, line.find('\r')) << std::endl;
+            ++failures;
+        }
+    }
+    if (failures > 0) {
+        return 1;
+    }
+    return per_lookup < TARGET_NS ? 0 : 1;
+}
+
+// Checks the byte count of logged responses: the body only, as %b
+// expects, and "-" for an empty one
+int runAccessLog() {
+    const std::string path = "xweb-bench-access.log";
+    std::remove(path.c_str());
+    ServerConfig config;
+    config.access_log_path = path;
+    config.access_log_format = ServerConfig::LogFormat::Common;
+    HttpRequest get;
+    get.method = "GET";
+    get.target = "/a.txt";
+    HttpRequest head = get;
+    head.method = "HEAD";
+    const std::string large(4096, 'x');
+    
+    OutputBuffer out;
+    std::vector<std::string> expected;
+    // The second log is built where the first one was; this thread's cached
+    // ring must not outlive the first
+    for (int round = 0; round < 2; ++round) {
+        AccessLog log(config);
+        auto respond = [&](const HttpRequest& request, std::string_view body, const char* bytes) {
+            // Responses follow one another in out, as when pipelined
+            size_t start = out.size();
+            WebServer::appendResponse(out, request, 200, "text/plain", body);
+            log.log(&request, 0, 200, AccessLog::bodyBytes(out, start));
+            expected.push_back(bytes);
+        };
+        respond(get, "hello", "5");
+        respond(head, "hello", "-");
+        respond(get, "", "-");
+        // A large body referenced rather than copied
+        size_t start = out.size();
+        WebServer::appendResponse(out, head, 200, "text/plain", large);
+        out.appendShared(large);
+        log.log(&get, 0, 200, AccessLog::bodyBytes(out, start));
+        expected.push_back("4096");
+    }
+    
+    std::ifstream file(path);
+    std::string line;
+    size_t checked = 0;
+    int failures = 0;
+    while (std::getline(file, line)) {
+        std::string suffix = " 200 " + (checked < expected.size() ? expected[checked] : "");
+        if (line.size() < suffix.size() ||
+            line.compare(line.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            std::cerr << "Expected \"" << suffix << "\" at the end of: " << line << std::endl;
+            ++failures;
+        }
+        ++checked;
+    }
+    std::remove(path.c_str());
+    if (checked != expected.size()) {
+        std::cerr << "Logged " << checked << " of " << expected.size() << " entries" << std::endl;
+        return 1;
+    }
+    std::cout << checked << " entries, " << failures << " wrong byte counts" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+// Cost of one histogram sample, the clock read excluded
+void runMetrics() {
+    constexpr int ITERATIONS = 10000000;
+    uint64_t start = Metrics::now();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        // Spread over buckets like real latencies
+        Metrics::record(Metrics::HANDLER, i & 1, 200, static_cast<uint64_t>(i & 0xffff) << 4);
+    }
+    double elapsed = static_cast<double>(Metrics::now() - start);
+    std::cout << std::fixed << std::setprecision(2) << elapsed / ITERATIONS << " ns/sample" << std::endl;
+}
+
+int run(const std::string& name) {
+    if (name == "scan") {
+        runScan();
+        return 0;
+    }
+    if (name == "alloc") {
+        return runAllocations();
+    }
+    if (name == "router") {
+        return runRouter();
+    }
+    if (name == "metrics") {
+        runMetrics();
+        return 0;
+    }
+    if (name == "accesslog") {
+        return runAccessLog();
+    }
+    std::cerr << "Unknown benchmark: " << name
+              << " (available: scan, alloc, router, metrics, accesslog)" << std::endl;
+    return 1;
+}
+
+} // namespace bench
+
+int main(int argc, char* argv[]) {
+    try {
+        if (argc == 3 && std::string(argv[1]) == "--bench") {
+            return bench::run(argv[2]);
+        }
+        
+        WebServer server(parseArguments(argc, argv));
         
         if (!server.start()) {
             std::cerr << "Failed to start server" << std::endl;